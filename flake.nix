@@ -8,8 +8,8 @@
         version = "2.1.3";
         src = self;
         buildInputs = [ pkgs.inih ];
-        buildPhase = "gcc -Wall -O3 -o succade src/succade.c -linih";
-        installPhase = "mkdir -p $out/bin; install -t $out/bin succade";
+        buildPhase = "gcc -Wall -O3 -pthread -o succade src/succade.c -linih -ldl; gcc -Wall -O3 -o succade-msg src/succade-msg.c; gcc -Wall -O3 -shared -fPIC -Isrc -o loadavg.so plugins/loadavg.c";
+        installPhase = "mkdir -p $out/bin $out/lib/succade; install -t $out/bin succade succade-msg; install -t $out/lib/succade loadavg.so";
       };
       defaultPackage = packages.succade;
       apps.succade = flake-utils.lib.mkApp { drv = packages.succade; };
@@ -0,0 +1,111 @@
+#include <stdio.h>     // snprintf()
+#include <stdlib.h>    // malloc(), free(), atoi()
+#include <fcntl.h>     // open(), O_RDONLY
+#include <unistd.h>    // pread(), close()
+#include "succade-plugin.h"
+
+//
+// Sample plugin: shows the system's load average, as found in /proc/loadavg.
+//
+//   command = plugin:/path/to/loadavg.so [1|5|15]
+//
+// The argument selects the 1, 5 or 15 minute average (default 1). Left-click
+// the block to toggle between the selected average and all three of them.
+// The kernel updates the averages every 5 seconds, so without an interval,
+// the plugin asks to be polled again every 5 seconds.
+//
+// Build with:
+//
+//   gcc -Wall -O3 -shared -fPIC -Isrc -o bin/loadavg.so plugins/loadavg.c
+//
+
+#define LOADAVG_PATH   "/proc/loadavg"
+#define LOADAVG_UPDATE 5.0
+
+struct loadavg
+{
+	int   fd;                // kept open, re-read with pread()
+	int   field;             // 0, 1 or 2 for the 1, 5 or 15 minute average
+	int   all;               // show all three averages?
+	succade_publish_fn publish;
+	void *handle;
+};
+
+static void *loadavg_init(const char *args, succade_publish_fn publish, void *handle)
+{
+	struct loadavg *la = malloc(sizeof(struct loadavg));
+	if (la == NULL)
+	{
+		return NULL;
+	}
+
+	la->fd = open(LOADAVG_PATH, O_RDONLY | O_CLOEXEC);
+	if (la->fd == -1)
+	{
+		free(la);
+		return NULL;
+	}
+
+	int minutes = atoi(args);
+	la->field   = minutes == 15 ? 2 : minutes == 5 ? 1 : 0;
+	la->all     = 0;
+	la->publish = publish;
+	la->handle  = handle;
+	return la;
+}
+
+static double loadavg_poll(void *ctx, const char *input)
+{
+	struct loadavg *la = ctx;
+
+	char buf[128];
+	ssize_t len = pread(la->fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+	{
+		return LOADAVG_UPDATE;
+	}
+	buf[len] = '\0';
+
+	double avg[3] = { 0.0 };
+	if (sscanf(buf, "%lf %lf %lf", &avg[0], &avg[1], &avg[2]) != 3)
+	{
+		return LOADAVG_UPDATE;
+	}
+
+	char out[64];
+	if (la->all)
+	{
+		snprintf(out, sizeof(out), "%.2f %.2f %.2f", avg[0], avg[1], avg[2]);
+	}
+	else
+	{
+		snprintf(out, sizeof(out), "%.2f", avg[la->field]);
+	}
+	la->publish(la->handle, out);
+	return LOADAVG_UPDATE;
+}
+
+static void loadavg_click(void *ctx, int button)
+{
+	struct loadavg *la = ctx;
+	if (button == 1)
+	{
+		la->all = !la->all;
+		loadavg_poll(la, NULL);
+	}
+}
+
+static void loadavg_free(void *ctx)
+{
+	struct loadavg *la = ctx;
+	close(la->fd);
+	free(la);
+}
+
+const struct succade_plugin succade_plugin = {
+	.abi   = SUCCADE_PLUGIN_ABI,
+	.init  = loadavg_init,
+	.poll  = loadavg_poll,
+	.click = loadavg_click,
+	.free  = loadavg_free
+};
@@ -0,0 +1,537 @@
+#include <stdio.h>     // snprintf()
+#include <stdlib.h>    // malloc(), realloc(), free()
+#include <string.h>    // strlen(), strchr()
+#include <time.h>      // clock_gettime(), localtime_r(), strftime()
+#include <fcntl.h>     // open(), O_RDONLY
+#include <unistd.h>    // pread(), close()
+#include "succade.h"   // thing_s, builtin_s
+
+//
+// BUILT-IN PROVIDERS
+//
+// Blocks with a command of the form `builtin:name [arg]` don't run a child
+// process; instead, their output is generated by succade itself, using one
+// of the providers below. They are scheduled, styled and clicked like any
+// other block. To add a provider, implement at least its `run` function and
+// add it to the `builtins` array at the bottom of this file.
+//
+
+//
+// builtin:clock [format]
+//
+
+#define BUILTIN_CLOCK_FORMAT "%H:%M"
+
+struct builtin_clock
+{
+	char   *format;          // strftime() format
+	time_t  res;             // resolution of the format, in seconds
+	time_t  valid_until;     // time at which `cached` will be outdated
+	char    cached[BUFFER_BLOCK_RESULT];
+};
+
+/*
+ * Returns 1 if the given strftime() format includes seconds, otherwise 0.
+ */
+static int clock_has_seconds(const char *format)
+{
+	for (const char *c = strchr(format, '%'); c; c = strchr(c + 1, '%'))
+	{
+		// skip the optional E and O modifiers
+		const char *conv = (c[1] == 'E' || c[1] == 'O') ? c + 2 : c + 1;
+		if (*conv == '%')
+		{
+			c = conv;
+			continue;
+		}
+		if (*conv && strchr("STsrXc+", *conv))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int clock_init(thing_s *block, const char *arg)
+{
+	struct builtin_clock *clock = malloc(sizeof(struct builtin_clock));
+	if (clock == NULL)
+	{
+		return -1;
+	}
+
+	*clock = (struct builtin_clock) { 0 };
+	clock->format = empty(arg) ? strdup(BUILTIN_CLOCK_FORMAT) :
+		is_quoted(arg) ? unquote(arg) : strdup(arg);
+	clock->res = clock_has_seconds(clock->format) ? 1 : 60;
+
+	block->data = clock;
+	return 0;
+}
+
+/*
+ * Formats the current time, but only calls localtime() and strftime() again
+ * once the cached result is outdated, that is, on the next second or minute
+ * boundary, depending on whether the format includes seconds or not.
+ */
+static double clock_run(thing_s *block, const char *input, char *buf, size_t len)
+{
+	struct builtin_clock *clock = block->data;
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	if (ts.tv_sec >= clock->valid_until)
+	{
+		struct tm tm;
+		localtime_r(&ts.tv_sec, &tm);
+		strftime(clock->cached, sizeof(clock->cached), clock->format, &tm);
+		clock->valid_until = ts.tv_sec + (clock->res == 1 ? 1 : 60 - tm.tm_sec);
+	}
+
+	snprintf(buf, len, "%s", clock->cached);
+	return (clock->valid_until - ts.tv_sec) - ts.tv_nsec / 1000000000.0;
+}
+
+static void clock_free(thing_s *block)
+{
+	struct builtin_clock *clock = block->data;
+	if (clock)
+	{
+		free(clock->format);
+		free(clock);
+	}
+}
+
+//
+// SAMPLER
+//
+// The system metric providers below all read their data from a handful of
+// files in /proc. Instead of every block opening and parsing these files on
+// every run, the sampler keeps them open and re-reads them with pread() at
+// most once per SAMPLER_MAX_AGE, sharing the result among all blocks. Blocks
+// keep their own previous values, so they can compute deltas over their own
+// interval. Parsing happens in place; the buffers are only ever reallocated
+// when a file has outgrown them, like /proc/stat on machines with many cores.
+//
+
+#define SAMPLER_BUFFER   16384
+#define SAMPLER_MAX_AGE    0.1
+#define SAMPLER_INTERVAL   1.0
+
+enum sampler_source
+{
+	SAMPLE_STAT,             // /proc/stat
+	SAMPLE_MEMINFO,          // /proc/meminfo
+	SAMPLE_NETDEV,           // /proc/net/dev
+	SAMPLE_COUNT
+};
+
+struct sampler_file
+{
+	const char *path;
+	int         fd;          // kept open between samples, -1 if not yet open
+	double      sampled;     // time of the last read
+	char       *buf;         // file contents, null terminated
+	size_t      size;        // size of `buf`
+};
+
+static struct sampler_file sampler_files[SAMPLE_COUNT] = {
+	[SAMPLE_STAT]    = { "/proc/stat",    -1 },
+	[SAMPLE_MEMINFO] = { "/proc/meminfo", -1 },
+	[SAMPLE_NETDEV]  = { "/proc/net/dev", -1 }
+};
+
+/*
+ * Returns the contents of the given source, which will be re-read if the last
+ * sample is older than SAMPLER_MAX_AGE. The file is read until EOF, growing
+ * the buffer (starting at SAMPLER_BUFFER bytes) as needed. Returns NULL on error.
+ */
+static const char *sample(enum sampler_source src)
+{
+	struct sampler_file *file = &sampler_files[src];
+	double now = get_time();
+
+	if (file->fd != -1 && now - file->sampled < SAMPLER_MAX_AGE)
+	{
+		return file->buf;
+	}
+
+	if (file->fd == -1 && (file->fd = open(file->path, O_RDONLY | O_CLOEXEC)) == -1)
+	{
+		return NULL;
+	}
+
+	size_t len = 0;
+	for (;;)
+	{
+		if (file->size - len < 2)
+		{
+			size_t size = file->size ? file->size * 2 : SAMPLER_BUFFER;
+			char *buf = realloc(file->buf, size);
+			if (buf == NULL)
+			{
+				return NULL;
+			}
+			file->buf  = buf;
+			file->size = size;
+		}
+
+		ssize_t got = pread(file->fd, file->buf + len, file->size - len - 1, len);
+		if (got < 0)
+		{
+			return NULL;
+		}
+		if (got == 0)
+		{
+			break;
+		}
+		len += got;
+	}
+
+	file->buf[len] = '\0';
+	file->sampled = now;
+	return file->buf;
+}
+
+/*
+ * Closes all files kept open by the sampler and frees their buffers.
+ */
+static void close_samplers()
+{
+	for (size_t i = 0; i < SAMPLE_COUNT; ++i)
+	{
+		if (sampler_files[i].fd != -1)
+		{
+			close(sampler_files[i].fd);
+			sampler_files[i].fd = -1;
+		}
+		free(sampler_files[i].buf);
+		sampler_files[i].buf  = NULL;
+		sampler_files[i].size = 0;
+	}
+}
+
+/*
+ * Returns a pointer to the first character after `key` in the line starting
+ * with `key`, after skipping any leading spaces, or NULL if there's no such
+ * line in `buf`.
+ */
+static const char *sample_find(const char *buf, const char *key)
+{
+	size_t key_len = strlen(key);
+	const char *line = buf;
+	while (*line)
+	{
+		line += strspn(line, " ");
+		if (strncmp(line, key, key_len) == 0)
+		{
+			return line + key_len;
+		}
+		line += strcspn(line, "\n");
+		line += (*line == '\n');
+	}
+	return NULL;
+}
+
+/*
+ * Writes the given number of bytes to `buf`, in a human readable format,
+ * using the suffixes B, K, M and G.
+ */
+static void human_bytes(double bytes, char *buf, size_t len)
+{
+	const char *units = "BKMG";
+	size_t u = 0;
+	while (bytes >= 1024.0 && u < strlen(units) - 1)
+	{
+		bytes /= 1024.0;
+		++u;
+	}
+	snprintf(buf, len, (bytes < 10.0 && u) ? "%.1f%c" : "%.0f%c", bytes, units[u]);
+}
+
+//
+// builtin:cpu[:N]
+//
+
+struct builtin_cpu
+{
+	char               key[16];   // "cpu " for all CPUs, "cpuN " for core N
+	unsigned long long total;     // jiffies spent in total, as of last run
+	unsigned long long idle;      // jiffies spent idle, as of last run
+	int                usage;     // last usage in percent, -1 if none yet
+};
+
+/*
+ * Reads the jiffies the CPU(s) have spent in total and idle into `total` and
+ * `idle`. Returns 0 on success, -1 if the CPU's line could not be found.
+ */
+static int cpu_sample(const struct builtin_cpu *cpu, unsigned long long *total,
+		unsigned long long *idle)
+{
+	const char *stat = sample(SAMPLE_STAT);
+	const char *fields = stat ? sample_find(stat, cpu->key) : NULL;
+	if (fields == NULL)
+	{
+		return -1;
+	}
+
+	// user nice system idle iowait irq softirq steal
+	*total = 0;
+	*idle  = 0;
+	char *end = (char *) fields;
+	for (int f = 0; f < 8; ++f)
+	{
+		unsigned long long val = strtoull(end, &end, 10);
+		*total += val;
+		*idle  += (f == 3 || f == 4) ? val : 0;
+	}
+	return 0;
+}
+
+static int cpu_init(thing_s *block, const char *arg)
+{
+	struct builtin_cpu *cpu = malloc(sizeof(struct builtin_cpu));
+	if (cpu == NULL)
+	{
+		return -1;
+	}
+	*cpu = (struct builtin_cpu) { .usage = -1 };
+	snprintf(cpu->key, sizeof(cpu->key), "cpu%s ", arg);
+
+	// prime the counters, so the first run doesn't report the usage since boot
+	cpu_sample(cpu, &cpu->total, &cpu->idle);
+
+	block->data = cpu;
+	return 0;
+}
+
+/*
+ * Outputs the CPU usage, in percent, since the block's last run. If there is
+ * no new sample since then, the last usage is repeated; if there is none yet,
+ * nothing is output and the block asks to be run again once there might be.
+ */
+static double cpu_run(thing_s *block, const char *input, char *buf, size_t len)
+{
+	struct builtin_cpu *cpu = block->data;
+
+	unsigned long long total, idle;
+	if (cpu_sample(cpu, &total, &idle) == -1)
+	{
+		return SAMPLER_INTERVAL;
+	}
+
+	unsigned long long d_total = total - cpu->total;
+	unsigned long long d_idle  = idle  - cpu->idle;
+	if (d_total)
+	{
+		cpu->usage = (int) (100.0 * (d_total - d_idle) / d_total + 0.5);
+		cpu->total = total;
+		cpu->idle  = idle;
+	}
+
+	if (cpu->usage == -1)
+	{
+		return SAMPLER_MAX_AGE;
+	}
+	snprintf(buf, len, "%d", cpu->usage);
+	return SAMPLER_INTERVAL;
+}
+
+static void cpu_free(thing_s *block)
+{
+	free(block->data);
+}
+
+//
+// builtin:mem [used|available]
+//
+
+static int mem_init(thing_s *block, const char *arg)
+{
+	block->data = strdup(arg);
+	return block->data ? 0 : -1;
+}
+
+/*
+ * Outputs the memory in use, in percent, or the memory used or available,
+ * in a human readable format, if the argument says so.
+ */
+static double mem_run(thing_s *block, const char *input, char *buf, size_t len)
+{
+	const char *arg = block->data;
+	const char *meminfo = sample(SAMPLE_MEMINFO);
+	const char *total_str = meminfo ? sample_find(meminfo, "MemTotal:") : NULL;
+	const char *avail_str = meminfo ? sample_find(meminfo, "MemAvailable:") : NULL;
+	if (total_str == NULL || avail_str == NULL)
+	{
+		return SAMPLER_INTERVAL;
+	}
+
+	// values are in KiB
+	double total = strtoull(total_str, NULL, 10) * 1024.0;
+	double avail = strtoull(avail_str, NULL, 10) * 1024.0;
+
+	if (equals(arg, "used"))
+	{
+		human_bytes(total - avail, buf, len);
+	}
+	else if (equals(arg, "available"))
+	{
+		human_bytes(avail, buf, len);
+	}
+	else
+	{
+		snprintf(buf, len, "%.0f", total ? 100.0 * (total - avail) / total : 0.0);
+	}
+	return SAMPLER_INTERVAL;
+}
+
+static void mem_free(thing_s *block)
+{
+	free(block->data);
+}
+
+//
+// builtin:net:IFACE [rx|tx]
+//
+
+struct builtin_net
+{
+	char               key[40];   // "IFACE:"
+	char               mode[8];   // "rx", "tx" or empty for both
+	unsigned long long rx;        // bytes received, as of last run
+	unsigned long long tx;        // bytes sent, as of last run
+	double             time;      // time of last run
+};
+
+static int net_init(thing_s *block, const char *arg)
+{
+	size_t iface_len = strcspn(arg, " ");
+	if (iface_len == 0 || iface_len > 32)
+	{
+		return -1;
+	}
+
+	struct builtin_net *net = malloc(sizeof(struct builtin_net));
+	if (net == NULL)
+	{
+		return -1;
+	}
+	*net = (struct builtin_net) { 0 };
+	snprintf(net->key, sizeof(net->key), "%.*s:", (int) iface_len, arg);
+	snprintf(net->mode, sizeof(net->mode), "%s", arg + iface_len + strspn(arg + iface_len, " "));
+
+	block->data = net;
+	return 0;
+}
+
+/*
+ * Outputs the interface's receive and/or transmit rate, in bytes per second,
+ * since the block's last run, in a human readable format.
+ */
+static double net_run(thing_s *block, const char *input, char *buf, size_t len)
+{
+	struct builtin_net *net = block->data;
+
+	const char *netdev = sample(SAMPLE_NETDEV);
+	const char *fields = netdev ? sample_find(netdev, net->key) : NULL;
+	if (fields == NULL)
+	{
+		return SAMPLER_INTERVAL;
+	}
+
+	// rx: bytes packets errs drop fifo frame compressed multicast, then tx
+	char *end = (char *) fields;
+	unsigned long long rx = strtoull(end, &end, 10);
+	for (int f = 0; f < 7; ++f)
+	{
+		strtoull(end, &end, 10);
+	}
+	unsigned long long tx = strtoull(end, &end, 10);
+
+	double now = get_time();
+	double secs = net->time ? now - net->time : 0.0;
+
+	// counters that went backwards have been reset, e.g. by a driver reload
+	unsigned long long d_rx = rx > net->rx ? rx - net->rx : 0;
+	unsigned long long d_tx = tx > net->tx ? tx - net->tx : 0;
+
+	char rx_str[16], tx_str[16];
+	human_bytes(secs > 0.0 ? d_rx / secs : 0.0, rx_str, sizeof(rx_str));
+	human_bytes(secs > 0.0 ? d_tx / secs : 0.0, tx_str, sizeof(tx_str));
+
+	net->rx   = rx;
+	net->tx   = tx;
+	net->time = now;
+
+	if (equals(net->mode, "rx") || equals(net->mode, "tx"))
+	{
+		snprintf(buf, len, "%s", equals(net->mode, "rx") ? rx_str : tx_str);
+	}
+	else
+	{
+		snprintf(buf, len, "%s %s", rx_str, tx_str);
+	}
+	return SAMPLER_INTERVAL;
+}
+
+static void net_free(thing_s *block)
+{
+	free(block->data);
+}
+
+//
+// REGISTRY
+//
+
+static const builtin_s builtins[] = {
+	{ "clock", clock_init, clock_run, clock_free },
+	{ "cpu",   cpu_init,   cpu_run,   cpu_free   },
+	{ "mem",   mem_init,   mem_run,   mem_free   },
+	{ "net",   net_init,   net_run,   net_free   }
+};
+
+/*
+ * Returns the built-in provider with the given name, or NULL.
+ */
+static const builtin_s *get_builtin(const char *name)
+{
+	for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i)
+	{
+		if (equals(builtins[i].name, name))
+		{
+			return &builtins[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Sets up the given block to use the built-in provider specified in `spec`,
+ * which is expected to have the format `name[:arg]` or `name [arg]`, as found
+ * after the `builtin:` prefix in the block's command.
+ * Returns 0 on success, -1 on error.
+ */
+static int init_builtin(thing_s *block, const char *spec)
+{
+	size_t name_len = strcspn(spec, ": ");
+	char name[name_len + 1];
+	snprintf(name, name_len + 1, "%s", spec);
+
+	const builtin_s *builtin = get_builtin(name);
+	if (builtin == NULL)
+	{
+		return -1;
+	}
+
+	const char *arg = (spec[name_len] == ':') ? spec + name_len + 1 :
+		spec + name_len + strspn(spec + name_len, " ");
+	if (builtin->init && builtin->init(block, arg) == -1)
+	{
+		return -1;
+	}
+
+	block->builtin = builtin;
+	return 0;
+}
@@ -128,5 +128,26 @@ char *cfg_get_str(const cfg_s *cfg, size_t idx)
 		cfg->opts[idx].s : NULL;
 }
 
+int cfg_same(const cfg_s *cfg1, const cfg_s *cfg2, size_t idx)
+{
+	if (idx >= cfg1->size || idx >= cfg2->size)
+		return 0;
+
+	if (cfg1->type[idx] != cfg2->type[idx])
+		return 0;
+
+	switch (cfg1->type[idx])
+	{
+		case OPT_TYPE_INT:
+			return cfg1->opts[idx].i == cfg2->opts[idx].i;
+		case OPT_TYPE_FLOAT:
+			return cfg1->opts[idx].f == cfg2->opts[idx].f;
+		case OPT_TYPE_STRING:
+			return strcmp(cfg1->opts[idx].s, cfg2->opts[idx].s) == 0;
+		default:
+			return 1;
+	}
+}
+
 #endif /* CFG_IMPLEMENTATION */
 #endif /* CFG_H */
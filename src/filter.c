@@ -0,0 +1,263 @@
+#include <stdio.h>     // fprintf()
+#include <stdlib.h>    // malloc(), free(), atoi()
+#include <string.h>    // strlen(), strstr(), strspn(), strcspn(), memmove()
+#include <regex.h>     // regcomp(), regexec(), regfree()
+#include "succade.h"   // thing_s, filter_s
+
+//
+// OUTPUT FILTERS
+//
+// Blocks can have parts of their output extracted or cleaned up by succade,
+// instead of piping their command through awk, sed or tr in a wrapper script.
+// Filters are set up once, by init_filter(), and applied to every output read
+// from the block, in place, before it is stored and compared to the previous
+// output. They are applied in this order:
+//
+//   regex-capture = REGEX     keep the first capture group (or whole match)
+//   field         = N         keep the Nth field (negative: from the end) ...
+//   split         = SEP       ... with fields separated by SEP (default: blanks)
+//   tr            = FROM [TO] replace characters in FROM with those in TO,
+//                             or delete them if TO is not given
+//   trim          = true      remove leading and trailing white space
+//   max-length    = N         keep at most N characters
+//
+
+#define FILTER_TR_DELETE -1
+
+/*
+ * Frees the given filter, including its compiled pattern, if any.
+ */
+static void free_filter(filter_s *filter)
+{
+	if (filter->has_regex)
+	{
+		regfree(&filter->regex);
+	}
+	free(filter);
+}
+
+/*
+ * Sets up the translation table of the filter from a `tr` option value, which
+ * has the format `FROM [TO]`. Like tr(1), if TO is shorter than FROM, its last
+ * character is used for the rest of FROM. Returns 0 on success, -1 on error.
+ */
+static int init_tr(filter_s *filter, const char *tr)
+{
+	size_t from_len = strcspn(tr, " ");
+	const char *to = tr + from_len + strspn(tr + from_len, " ");
+	size_t to_len = strlen(to);
+	if (from_len == 0)
+	{
+		return -1;
+	}
+
+	for (int c = 0; c < 256; ++c)
+	{
+		filter->tr[c] = c;
+	}
+	for (size_t i = 0; i < from_len; ++i)
+	{
+		unsigned char from = tr[i];
+		filter->tr[from] = to_len == 0 ? FILTER_TR_DELETE :
+			(unsigned char) to[i < to_len ? i : to_len - 1];
+	}
+	filter->has_tr = 1;
+	return 0;
+}
+
+/*
+ * Creates the output filter for the given block from its config, if it has
+ * any filter options set. The regular expression is compiled right here.
+ * Returns 0 on success (or if there are no filters), -1 on error.
+ */
+static int init_filter(thing_s *block)
+{
+	const cfg_s *bcfg = &block->cfg;
+
+	// `field` selects the source's field for sourced blocks, see demux_block()
+	const char *field = block->b_type == BLOCK_SOURCED ? NULL : cfg_get_str(bcfg, BLOCK_OPT_FIELD);
+	const char *regex = cfg_get_str(bcfg, BLOCK_OPT_REGEX);
+	const char *tr    = cfg_get_str(bcfg, BLOCK_OPT_TR);
+	int trim          = cfg_get_int(bcfg, BLOCK_OPT_TRIM);
+	int max_len       = cfg_get_int(bcfg, BLOCK_OPT_MAX_LENGTH);
+	if (!field && !regex && !tr && !trim && max_len <= 0)
+	{
+		return 0;
+	}
+
+	filter_s *filter = malloc(sizeof(filter_s));
+	if (filter == NULL)
+	{
+		return -1;
+	}
+	*filter = (filter_s) { 0 };
+	filter->field   = field ? atoi(field) : 0;
+	filter->split   = cfg_get_str(bcfg, BLOCK_OPT_SPLIT);
+	filter->trim    = trim;
+	filter->max_len = max_len > 0 ? max_len : 0;
+
+	// an empty separator would never let us get past the first field
+	if (filter->split && filter->split[0] == '\0')
+	{
+		fprintf(stderr, "init_filter(): empty split for block '%s'\n", block->sid);
+		free_filter(filter);
+		return -1;
+	}
+
+	if (regex)
+	{
+		if (regcomp(&filter->regex, regex, REG_EXTENDED) != 0)
+		{
+			fprintf(stderr, "init_filter(): invalid pattern in regex-capture of '%s'\n", block->sid);
+			free_filter(filter);
+			return -1;
+		}
+		filter->has_regex = 1;
+	}
+
+	if (tr && init_tr(filter, tr) == -1)
+	{
+		fprintf(stderr, "init_filter(): invalid tr for block '%s'\n", block->sid);
+		free_filter(filter);
+		return -1;
+	}
+
+	block->filter = filter;
+	return 0;
+}
+
+/*
+ * Moves the `len` bytes at `start` to the beginning of `str`, terminating it.
+ */
+static void keep_range(char *str, const char *start, size_t len)
+{
+	memmove(str, start, len);
+	str[len] = '\0';
+}
+
+/*
+ * Finds the start of the given field (1-based) in `str`, with fields
+ * separated by the string `sep`, or by runs of blanks if `sep` is NULL.
+ * Sets `len` to the field's length. Returns NULL if there's no such field.
+ */
+static const char *find_nth_field(const char *str, const char *sep, int n, size_t *len)
+{
+	size_t sep_len = sep ? strlen(sep) : 0;
+	const char *field = sep ? str : str + strspn(str, " \t");
+
+	for (int i = 1; *field || (sep && i == n); ++i)
+	{
+		const char *end = sep ? strstr(field, sep) : field + strcspn(field, " \t");
+		if (end == NULL)
+		{
+			end = field + strlen(field);
+		}
+		if (i == n)
+		{
+			*len = end - field;
+			return field;
+		}
+		if (*end == '\0')
+		{
+			break;
+		}
+		field = sep ? end + sep_len : end + strspn(end, " \t");
+	}
+	return NULL;
+}
+
+/*
+ * Counts the fields in `str`, as separated according to find_nth_field().
+ */
+static int count_fields(const char *str, const char *sep)
+{
+	int count = 0;
+	size_t len = 0;
+	while (find_nth_field(str, sep, count + 1, &len))
+	{
+		++count;
+	}
+	return count;
+}
+
+/*
+ * Applies the block's filters, if any, to the given output, in place.
+ */
+static void filter_output(const thing_s *block, char *output)
+{
+	const filter_s *filter = block->filter;
+	if (filter == NULL || output == NULL)
+	{
+		return;
+	}
+
+	if (filter->has_regex)
+	{
+		regmatch_t m[2];
+		if (regexec(&filter->regex, output, 2, m, 0) != 0)
+		{
+			output[0] = '\0';
+		}
+		else
+		{
+			regmatch_t *keep = (filter->regex.re_nsub && m[1].rm_so != -1) ? &m[1] : &m[0];
+			keep_range(output, output + keep->rm_so, keep->rm_eo - keep->rm_so);
+		}
+	}
+
+	if (filter->field)
+	{
+		int n = filter->field > 0 ? filter->field :
+			count_fields(output, filter->split) + filter->field + 1;
+		size_t len = 0;
+		const char *field = n > 0 ? find_nth_field(output, filter->split, n, &len) : NULL;
+		if (field)
+		{
+			keep_range(output, field, len);
+		}
+		else
+		{
+			output[0] = '\0';
+		}
+	}
+
+	if (filter->has_tr)
+	{
+		char *out = output;
+		for (const char *c = output; *c; ++c)
+		{
+			short to = filter->tr[(unsigned char) *c];
+			if (to != FILTER_TR_DELETE)
+			{
+				*out++ = to;
+			}
+		}
+		*out = '\0';
+	}
+
+	if (filter->trim)
+	{
+		size_t lead = strspn(output, " \t\r\n");
+		size_t len = strlen(output + lead);
+		while (len && strchr(" \t\r\n", output[lead + len - 1]))
+		{
+			--len;
+		}
+		keep_range(output, output + lead, len);
+	}
+
+	if (filter->max_len)
+	{
+		// count characters, not bytes, by skipping UTF-8 continuation bytes
+		size_t chars = 0;
+		char *c = output;
+		for (; *c; ++c)
+		{
+			if ((*c & 0xC0) != 0x80 && chars++ == filter->max_len)
+			{
+				*c = '\0';
+				break;
+			}
+		}
+	}
+}
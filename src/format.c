@@ -0,0 +1,299 @@
+#include <stdio.h>     // snprintf()
+#include <stdlib.h>    // malloc(), free(), strtod()
+#include <string.h>    // strlen(), strspn(), strcspn(), strdup()
+#include "succade.h"   // thing_s, fmt_s, rule_s
+
+//
+// OUTPUT FORMATTERS
+//
+// Blocks can have their output formatted by succade, instead of wrapping
+// their command in a script that does so. All formatter options are parsed
+// once, by init_fmt(), and applied whenever the block's output changes, by
+// apply_fmt(). The original output is kept as-is, for subscribers and other
+// blocks, while the formatted text, color and label are used for the bar.
+//
+//   map           = KEY VALUE, ...    replace output KEY with VALUE
+//   format        = %.1f | bytes | bar:WIDTH[:FE]
+//   foreground-if = OP NUMBER VALUE, ...
+//   background-if = OP NUMBER VALUE, ...
+//   label-if      = OP NUMBER VALUE, ...
+//
+// OP is one of <, <=, >, >= (comparing the output's leading number) or =
+// (comparing the whole output as a string, in which case NUMBER can be any
+// word). The first matching rule wins.
+//
+
+/*
+ * Returns 1 if `format` is a printf() format for exactly one double, with
+ * nothing but literal text and "%%" around it, otherwise 0.
+ */
+static int is_number_format(const char *format)
+{
+	int conversions = 0;
+	for (const char *c = strchr(format, '%'); c; c = strchr(c + 1, '%'))
+	{
+		if (c[1] == '%')
+		{
+			++c;
+			continue;
+		}
+		c += 1 + strspn(c + 1, "-+ #0123456789.");
+		if (*c == '\0' || strchr("fFeEgGaA", *c) == NULL)
+		{
+			return 0;
+		}
+		++conversions;
+	}
+	return conversions == 1;
+}
+
+static void free_rules(rule_s *rules, size_t num)
+{
+	for (size_t i = 0; i < num; ++i)
+	{
+		free(rules[i].key);
+		free(rules[i].value);
+	}
+	free(rules);
+}
+
+/*
+ * Parses a comma-separated list of `OP ARG VALUE` rules (or `KEY VALUE` pairs
+ * if `ops` is 0) into a newly allocated array, returning the number of rules
+ * in `num`. Returns NULL on error.
+ */
+static rule_s *parse_rules(const char *str, int ops, size_t *num)
+{
+	*num = 0;
+	size_t max = 1;
+	for (const char *c = str; *c; ++c)
+	{
+		max += (*c == ',');
+	}
+
+	rule_s *rules = malloc(sizeof(rule_s) * max);
+	if (rules == NULL)
+	{
+		return NULL;
+	}
+
+	for (const char *entry = str; *entry; )
+	{
+		entry += strspn(entry, " ");
+		size_t entry_len = strcspn(entry, ",");
+		if (entry_len == 0)
+		{
+			entry += (*entry == ',');
+			continue;
+		}
+		rule_s *rule = &rules[*num];
+		*rule = (rule_s) { 0 };
+
+		// operator
+		const char *arg = entry;
+		if (ops)
+		{
+			size_t op_len = strspn(entry, "<>=");
+			if (op_len == 0 || op_len > 2 || (op_len == 2 && (entry[0] == '=' || entry[1] != '=')))
+			{
+				free_rules(rules, *num);
+				return NULL;
+			}
+			rule->op[0] = entry[0];
+			rule->op[1] = op_len == 2 ? entry[1] : '\0';
+			arg += op_len + strspn(entry + op_len, " ");
+		}
+
+		// argument (key or number) and value, trailing spaces trimmed
+		const char *end = entry + entry_len;
+		size_t arg_len = strcspn(arg, " ,");
+		const char *value = arg + arg_len + strspn(arg + arg_len, " ");
+		value = value > end ? end : value;
+		size_t value_len = end - value;
+		while (value_len && value[value_len - 1] == ' ')
+		{
+			--value_len;
+		}
+
+		rule->key   = strndup(arg, arg_len);
+		rule->value = strndup(value, value_len);
+		rule->limit = strtod(rule->key, NULL);
+		*num += 1;
+
+		entry = *end ? end + 1 : end;
+	}
+	return rules;
+}
+
+/*
+ * Returns the value of the first rule that matches the given output, or NULL
+ * if no rule matches. `num` is the output's leading number, if `is_num` is 1;
+ * otherwise, only string comparisons can match.
+ */
+static const char *match_rules(const rule_s *rules, size_t len, const char *output, 
+		double num, int is_num)
+{
+	for (size_t i = 0; i < len; ++i)
+	{
+		const rule_s *r = &rules[i];
+		int match = 0;
+		switch (r->op[0])
+		{
+			case '<': match = is_num && (r->op[1] ? num <= r->limit : num < r->limit); break;
+			case '>': match = is_num && (r->op[1] ? num >= r->limit : num > r->limit); break;
+			case '=': match = equals(output, r->key); break;
+		}
+		if (match)
+		{
+			return r->value;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Frees the given formatter, including all of its rules.
+ */
+static void free_fmt(fmt_s *fmt)
+{
+	free_rules(fmt->map, fmt->num_map);
+	free_rules(fmt->fg, fmt->num_fg);
+	free_rules(fmt->bg, fmt->num_bg);
+	free_rules(fmt->label, fmt->num_label);
+	free(fmt->text);
+	free(fmt);
+}
+
+/*
+ * Creates the formatter for the given block from its config, if it has any
+ * formatter options set. Returns 0 on success (or if there are none), -1 on
+ * error, in which case the block's output won't be formatted.
+ */
+static int init_fmt(thing_s *block)
+{
+	const cfg_s *bcfg = &block->cfg;
+	const char *map    = cfg_get_str(bcfg, BLOCK_OPT_MAP);
+	const char *format = cfg_get_str(bcfg, BLOCK_OPT_FORMAT);
+	const char *fg     = cfg_get_str(bcfg, BLOCK_OPT_FG_IF);
+	const char *bg     = cfg_get_str(bcfg, BLOCK_OPT_BG_IF);
+	const char *label  = cfg_get_str(bcfg, BLOCK_OPT_LABEL_IF);
+	if (!map && !format && !fg && !bg && !label)
+	{
+		return 0;
+	}
+
+	fmt_s *fmt = malloc(sizeof(fmt_s));
+	if (fmt == NULL)
+	{
+		return -1;
+	}
+	*fmt = (fmt_s) { 0 };
+
+	if (format)
+	{
+		if (equals(format, "bytes"))
+		{
+			fmt->bytes = 1;
+		}
+		else if (has_prefix(format, "bar:"))
+		{
+			char *end = NULL;
+			fmt->bar = strtol(format + 4, &end, 10);
+			fmt->bar_full  = (end[0] == ':' && end[1]) ? end[1] : FORMAT_BAR_FULL;
+			fmt->bar_empty = (end[0] == ':' && end[1] && end[2]) ? end[2] : FORMAT_BAR_EMPTY;
+			if (fmt->bar <= 0 || fmt->bar >= BUFFER_BLOCK_RESULT)
+			{
+				fprintf(stderr, "init_fmt(): invalid bar width in format of '%s'\n", block->sid);
+				free_fmt(fmt);
+				return -1;
+			}
+		}
+		else if (is_number_format(format))
+		{
+			fmt->number = format;
+		}
+		else
+		{
+			fprintf(stderr, "init_fmt(): invalid format for block '%s'\n", block->sid);
+			free_fmt(fmt);
+			return -1;
+		}
+	}
+
+	if ((map   && (fmt->map   = parse_rules(map,   0, &fmt->num_map))   == NULL) ||
+	    (fg    && (fmt->fg    = parse_rules(fg,    1, &fmt->num_fg))    == NULL) ||
+	    (bg    && (fmt->bg    = parse_rules(bg,    1, &fmt->num_bg))    == NULL) ||
+	    (label && (fmt->label = parse_rules(label, 1, &fmt->num_label)) == NULL))
+	{
+		fprintf(stderr, "init_fmt(): invalid rules for block '%s'\n", block->sid);
+		free_fmt(fmt);
+		return -1;
+	}
+
+	block->fmt = fmt;
+	return 0;
+}
+
+/*
+ * Formats the given block's current output as configured, if the block has
+ * a formatter: sets the formatter's text, as well as the color and label to
+ * use instead of the configured ones (NULL if there is no matching rule).
+ */
+static void apply_fmt(thing_s *block)
+{
+	fmt_s *fmt = block->fmt;
+	if (fmt == NULL)
+	{
+		return;
+	}
+
+	const char *output = block->output ? block->output : "";
+	char *end = NULL;
+	double num = strtod(output, &end);
+	int is_num = (end != output);
+
+	fmt->cur_fg    = match_rules(fmt->fg,    fmt->num_fg,    output, num, is_num);
+	fmt->cur_bg    = match_rules(fmt->bg,    fmt->num_bg,    output, num, is_num);
+	fmt->cur_label = match_rules(fmt->label, fmt->num_label, output, num, is_num);
+
+	char buf[BUFFER_BLOCK_RESULT];
+	const char *mapped = NULL;
+	for (size_t i = 0; i < fmt->num_map && !mapped; ++i)
+	{
+		mapped = equals(output, fmt->map[i].key) ? fmt->map[i].value : NULL;
+	}
+
+	if (mapped)
+	{
+		snprintf(buf, sizeof(buf), "%s", mapped);
+	}
+	else if (!is_num)
+	{
+		snprintf(buf, sizeof(buf), "%s", output);
+	}
+	else if (fmt->number)
+	{
+		snprintf(buf, sizeof(buf), fmt->number, num);
+	}
+	else if (fmt->bytes)
+	{
+		human_bytes(num, buf, sizeof(buf));
+	}
+	else if (fmt->bar)
+	{
+		double pct = num < 0.0 ? 0.0 : num > 100.0 ? 100.0 : num;
+		int full = (int) (pct * fmt->bar / 100.0 + 0.5);
+		for (int i = 0; i < fmt->bar; ++i)
+		{
+			buf[i] = i < full ? fmt->bar_full : fmt->bar_empty;
+		}
+		buf[fmt->bar] = '\0';
+	}
+	else
+	{
+		snprintf(buf, sizeof(buf), "%s", output);
+	}
+
+	free(fmt->text);
+	fmt->text = strdup(buf);
+}
@@ -2,6 +2,8 @@
 #include <stdlib.h> // malloc(), free(), getenv()
 #include <string.h> // strlen(), strcmp()
 #include <time.h>   // clock_gettime(), clockid_t, struct timespec
+#include <unistd.h> // getuid()
+#include <sys/stat.h> // mkdir(), lstat()
 
 /*
  * Returns 1 if both input strings are equal, otherwise 0.
@@ -19,6 +21,30 @@ int empty(const char *str)
 	return (str == NULL || str[0] == '\0');
 }
 
+/*
+ * Returns 1 if the input string starts with the given prefix, otherwise 0.
+ */
+int has_prefix(const char *str, const char *prefix)
+{
+	return strncmp(str, prefix, strlen(prefix)) == 0;
+}
+
+/*
+ * Terminates the first word of the given string, that is, replaces the first 
+ * space with a null terminator. Returns a pointer to the next word, skipping 
+ * any additional spaces, or to the end of the string if there is none.
+ */
+char *split_word(char *str)
+{
+	char *end = str + strcspn(str, " ");
+	if (*end == '\0')
+	{
+		return end;
+	}
+	*end = '\0';
+	return end + 1 + strspn(end + 1, " ");
+}
+
 /*
  * Returns 1 if the input string is quoted, otherwise 0.
  */
@@ -228,6 +254,47 @@ char *config_path(const char *filename, const char *dirname)
 	return cfg_path;
 }
 
+/*
+ * Given a file name, returns the path of that file within the user's runtime 
+ * directory (XDG_RUNTIME_DIR), as a malloc'd string that the caller has to 
+ * free. Used for sockets and the like. If there is no runtime directory, our
+ * own directory in /tmp, `/tmp/succade-UID`, is used instead, which will be 
+ * created if need be. As anybody can create files in /tmp, that directory is
+ * only used if it is a real directory, owned by us and private to us. 
+ * Returns NULL if it isn't.
+ */
+char *runtime_path(const char *filename)
+{
+	char *run_dir = getenv("XDG_RUNTIME_DIR");
+	if (!empty(run_dir))
+	{
+		return filepath(run_dir, filename, NULL);
+	}
+
+	char tmp_dir[32];
+	snprintf(tmp_dir, sizeof(tmp_dir), "/tmp/succade-%u", (unsigned) getuid());
+	mkdir(tmp_dir, 0700);
+
+	struct stat st;
+	if (lstat(tmp_dir, &st) == -1 || !S_ISDIR(st.st_mode) || 
+	    st.st_uid != getuid() || (st.st_mode & 0077))
+	{
+		return NULL;
+	}
+	return filepath(tmp_dir, filename, NULL);
+}
+
+/*
+ * Returns the current value of the clock `cid`, in seconds, as a floating 
+ * point number. What the value is relative to depends on the clock used.
+ */
+double get_clock(clockid_t cid)
+{
+	struct timespec ts;
+	clock_gettime(cid, &ts);
+	return (double) ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
 /*
  * Returns the seconds that have passed since an unspecified starting point,
  * (see CLOCK_MONOTONIC), in seconds, as a floating point number.
@@ -240,9 +307,18 @@ double get_time()
 	// I don't want to call sysconf() with every single iteration
 	// of the main loop, so let's do this ONCE and remember...
 	//clockid_t cid = (sysconf(_SC_MONOTONIC_CLOCK) > 0) ? CLOCK_MONOTONIC : CLOCK_REALTIME;
-	struct timespec ts;
-	clock_gettime(cid, &ts);
-	return (double) ts.tv_sec + ts.tv_nsec / 1000000000.0;
+	return get_clock(cid);
+}
+
+/*
+ * Returns the seconds the system has spent suspended since boot, that is the 
+ * difference between CLOCK_BOOTTIME (which includes time spent in suspend) and 
+ * CLOCK_MONOTONIC (which does not). If two subsequent calls return different 
+ * values, the system has been suspended (and resumed) in between the calls.
+ */
+double get_slept()
+{
+	return get_clock(CLOCK_BOOTTIME) - get_clock(CLOCK_MONOTONIC);
 }
 
 /*
@@ -20,6 +20,7 @@
 // Buffers etc
 #define KITA_BUFFER_SIZE 2048
 #define KITA_MS_PER_S    1000
+#define KITA_MAX_STAGES     8  // max number of commands in a pipeline
 
 // Errors
 #define KITA_ERR_NONE              0
@@ -67,6 +68,9 @@ enum kita_evt_type {
 	KITA_EVT_CHILD_READOK,   // child has data available to read
 	KITA_EVT_CHILD_REMOVE,   // child is about to be removed from state
 	KITA_EVT_CHILD_ERROR,    // an error occurred
+	KITA_EVT_WATCH_READOK,   // watched fd has data available to read
+	KITA_EVT_WATCH_FEEDOK,   // watched fd is ready to be written to
+	KITA_EVT_WATCH_HANGUP,   // watched fd has hung up or errored
 	KITA_EVT_COUNT
 };
 
@@ -92,12 +96,14 @@ struct kita_child;
 struct kita_event;
 struct kita_calls;
 struct kita_stream;
+struct kita_watch;
 
 typedef struct kita_state kita_state_s;
 typedef struct kita_child kita_child_s;
 typedef struct kita_event kita_event_s;
 typedef struct kita_calls kita_calls_s;
 typedef struct kita_stream kita_stream_s;
+typedef struct kita_watch kita_watch_s;
 
 typedef void (*kita_call_c)(kita_state_s* s, kita_event_s* e);
 
@@ -115,7 +121,9 @@ struct kita_child
 {
 	char* cmd;               // command/binary to run (could have arguments)
 	char* arg;               // additional argument string (optional)
-	pid_t pid;               // process ID
+	pid_t pid;               // process ID (of the last stage, for pipelines)
+	pid_t stages[KITA_MAX_STAGES-1]; // PIDs of a pipeline's other stages, 0 once reaped
+	unsigned exited : 1;     // has `pid` exited while other stages still run?
 
 	kita_stream_s* io[3];    // stream objects for stdin, stdout, stderr
 	int status;              // status returned by waitpid(), if any
@@ -125,9 +133,17 @@ struct kita_child
 	void* ctx;               // user data
 };
 
+struct kita_watch
+{
+	int fd;                  // file descriptor to monitor (not owned)
+	kita_state_s* state;     // tracking state, if any
+	void* ctx;               // user data
+};
+
 struct kita_event
 {
 	kita_child_s* child;     // associated child process
+	kita_watch_s* watch;     // associated watch, if not a child event
 	kita_evt_type_e type;    // event type
 	kita_ios_type_e ios;     // stdin, stdout, stderr?
 	int fd;                  // file descriptor for the relevant child's stream
@@ -139,6 +155,9 @@ struct kita_state
 	kita_child_s** children; // child processes
 	size_t num_children;     // num of child processes
 
+	kita_watch_s** watches;  // arbitrary file descriptors to monitor
+	size_t num_watches;      // num of watches
+
 	kita_call_c cbs[KITA_EVT_COUNT]; // event callbacks
 
 	int epfd;                // epoll file descriptor
@@ -179,6 +198,7 @@ kita_state_s* kita_child_get_state(kita_child_s* c);
 // Children: opening, reading, writing, killing
 int   kita_child_feed(kita_child_s* c, const char* str);
 char* kita_child_read(kita_child_s* c, kita_ios_type_e n);
+char* kita_child_read_lines(kita_child_s* c, kita_ios_type_e n);
 int   kita_child_open(kita_child_s* c);
 int   kita_child_close(kita_child_s* c); 
 int   kita_child_reap(kita_child_s* c);
@@ -189,6 +209,15 @@ int   kita_child_term(kita_child_s* c);
 int kita_child_is_open(kita_child_s* c);
 int kita_child_is_alive(kita_child_s* c);
 
+// Watches: monitoring arbitrary file descriptors (timerfd, sockets, ...)
+kita_watch_s* kita_watch_new(int fd);
+int           kita_watch_add(kita_state_s* s, kita_watch_s* w);
+int           kita_watch_del(kita_state_s* s, kita_watch_s* w);
+void          kita_watch_free(kita_watch_s** w);
+void          kita_watch_set_context(kita_watch_s* w, void *ctx);
+void*         kita_watch_get_context(kita_watch_s* w);
+int           kita_watch_set_feed(kita_watch_s* w, int feed);
+
 // Clean-up and shut-down
 void kita_kill(kita_state_s* s);
 void kita_free(kita_state_s** s);
@@ -239,110 +268,280 @@ libkita_empty(const char *str)
 	return (str == NULL || str[0] == '\0');
 }
 
+/*
+ * Creates a pipe like pipe() does, but with the close-on-exec flag set on
+ * both ends, so that they will only be inherited by those child processes
+ * that explicitly dup2() them. This is used for the pipes between the stages
+ * of a pipeline: a stage holding on to the write end of another stage's stdin
+ * would keep that stage from ever seeing EOF. Returns 0 on success, -1 on 
+ * error.
+ */
+static int
+libkita_pipe(int fds[2])
+{
+	if (pipe(fds) < 0)
+	{
+		return -1;
+	}
+	if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) == -1 ||
+	    fcntl(fds[1], F_SETFD, FD_CLOEXEC) == -1)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Splits `cmd` into the commands of a pipeline, in place, by replacing every 
+ * `|` that is neither quoted nor escaped with a null terminator. Pointers to 
+ * the individual commands are stored in `stages`. Returns the number of 
+ * commands or -1 if there are more than `max` or if any of them is empty.
+ */
+static int
+libkita_split_pipeline(char *cmd, char **stages, int max)
+{
+	int num = 0;
+	char quote = 0;
+	stages[num++] = cmd;
+
+	for (char *c = cmd; *c; ++c)
+	{
+		if (*c == '\\' && quote != '\'' && c[1])
+		{
+			++c; // skip the escaped character
+		}
+		else if (quote)
+		{
+			quote = (*c == quote) ? 0 : quote;
+		}
+		else if (*c == '\'' || *c == '"')
+		{
+			quote = *c;
+		}
+		else if (*c == '|')
+		{
+			if (num == max)
+			{
+				return -1;
+			}
+			*c = '\0';
+			stages[num++] = c + 1;
+		}
+	}
+
+	for (int i = 0; i < num; ++i)
+	{
+		if (stages[i][strspn(stages[i], " \t")] == '\0')
+		{
+			return -1;
+		}
+	}
+	return num;
+}
+
 /*
  * Opens the process `cmd` similar to popen() but does not invoke a shell.
  * Instead, wordexp() is used to expand the given command, if necessary.
- * If successful, the process id of the new process is being returned and the 
+ * `cmd` can be a pipeline (`a | b | c`), in which case every command will be 
+ * run as a process of its own, with the stdout of each connected to the stdin
+ * of the next one. The given stdin pipe leads to the first command, the stdout
+ * pipe comes from the last one and all of them share the stderr pipe. 
+ * If successful, the process id of the new (last) process is being returned,
+ * the PIDs of all other processes of a pipeline are stored in `stages` (which
+ * needs room for KITA_MAX_STAGES-1 of them, unused ones are set to 0) and the
  * given FILE pointers are set to streams that correspond to pipes for reading 
  * and writing to the child process, accordingly. Hand in NULL for pipes that
- * should not be used. On error, -1 is returned. Note that the child process 
+ * should not be used. If `arg` is given, it is added to the last command's
+ * arguments as-is, without being expanded or split into words or commands.
+ * On error, -1 is returned. Note that the child process 
  * might have failed to execute the given `cmd` (and therefore ended exection); 
  * the return value of this function only indicates whether the child process 
  * was successfully forked or not.
  */
 static pid_t
-libkita_popen(const char *cmd, FILE **in, FILE **out, FILE **err)
+libkita_popen(const char *cmd, const char *arg, pid_t *stages, FILE **in, FILE **out, FILE **err)
 {
 	if (!cmd || !strlen(cmd))
 	{
 		return -1;
 	}
 
-	// 0 = read end of pipes, 1 = write end of pipes
-	int pipe_stdin[2];
-	int pipe_stdout[2];
-	int pipe_stderr[2];
-
-	if (in && (pipe(pipe_stdin) < 0))
-	{
-		return -1;
-	}
-	if (out && (pipe(pipe_stdout) < 0))
-	{
-		return -1;
-	}
-	if (err && (pipe(pipe_stderr) < 0))
+	char *pipeline = strdup(cmd);
+	char *cmds[KITA_MAX_STAGES];
+	int num_cmds = pipeline ? libkita_split_pipeline(pipeline, cmds, KITA_MAX_STAGES) : -1;
+	if (num_cmds == -1)
 	{
+		free(pipeline);
 		return -1;
 	}
 
-	pid_t pid = fork();
-	if (pid == -1)
+	// 0 = read end of pipes, 1 = write end of pipes
+	int pipe_stdin[2]  = { -1, -1 };
+	int pipe_stdout[2] = { -1, -1 };
+	int pipe_stderr[2] = { -1, -1 };
+
+	pid_t pid = -1;
+	if ((in  && pipe(pipe_stdin)  < 0) ||
+	    (out && pipe(pipe_stdout) < 0) ||
+	    (err && pipe(pipe_stderr) < 0))
 	{
-		return -1;
+		num_cmds = 0; // don't start anything, just clean up
 	}
-	else if (pid == 0) // child
+
+	// read end of the pipe that leads to the current command's stdin, if any
+	int prev = pipe_stdin[0];
+
+	// number of stages other than the last one that have been started
+	int started = 0;
+
+	for (int i = 0; i < num_cmds; ++i)
 	{
-		// redirect stdin to the read end of this pipe
-		if (in)
+		int last = (i == num_cmds - 1);
+
+		// pipe from the current command to the next one
+		int next[2] = { -1, -1 };
+		if (!last && libkita_pipe(next) < 0)
 		{
-			if (dup2(pipe_stdin[0], STDIN_FILENO) == -1)
-			{
-				_exit(-1);
-			}
-			close(pipe_stdin[1]); // child doesn't need write end
+			pid = -1;
+			break;
 		}
-		// redirect stdout to the write end of this pipe
-		if (out)
+
+		pid = fork();
+		if (pid == -1)
 		{
-			if (dup2(pipe_stdout[1], STDOUT_FILENO) == -1)
-			{
-				_exit(-1);
-			}
-			close(pipe_stdout[0]); // child doesn't need read end
+			close(next[0]);
+			close(next[1]);
+			break;
 		}
-		// redirect stderr to the write end of this pipe
-		if (err)
+		else if (pid == 0) // child
 		{
-			if (dup2(pipe_stderr[1], STDERR_FILENO) == -1)
+			// don't pass on signals that the parent might have blocked
+			sigset_t sigset;
+			sigemptyset(&sigset);
+			sigprocmask(SIG_SETMASK, &sigset, NULL);
+
+			// child doesn't need the parent's ends of the pipes, nor
+			// the stdin/stdout pipes if it isn't the first/last stage
+			// (pipes between stages are closed on exec anyway)
+			if (in)
+			{
+				close(pipe_stdin[1]);
+			}
+			if (in && i > 0)
+			{
+				close(pipe_stdin[0]);
+			}
+			if (out)
+			{
+				close(pipe_stdout[0]);
+			}
+			if (out && !last)
+			{
+				close(pipe_stdout[1]);
+			}
+			if (err)
+			{
+				close(pipe_stderr[0]);
+			}
+
+			// redirect stdin to the previous command or the stdin pipe
+			if (prev != -1 && dup2(prev, STDIN_FILENO) == -1)
+			{
+				_exit(127);
+			}
+			// redirect stdout to the next command or the stdout pipe
+			int to = last ? pipe_stdout[1] : next[1];
+			if (to != -1 && dup2(to, STDOUT_FILENO) == -1)
+			{
+				_exit(127);
+			}
+			// redirect stderr to the write end of this pipe
+			if (err && dup2(pipe_stderr[1], STDERR_FILENO) == -1)
 			{
-				_exit(-1);
+				_exit(127);
 			}
-			close(pipe_stderr[0]); // child doesn't need read end
+
+			wordexp_t p;
+			if (wordexp(cmds[i], &p, 0) != 0 || p.we_wordc == 0)
+			{
+				_exit(127);
+			}
+
+			// the additional argument goes to the last command, verbatim
+			char *argv[p.we_wordc + 2];
+			memcpy(argv, p.we_wordv, sizeof(char *) * p.we_wordc);
+			argv[p.we_wordc] = (last && arg) ? (char *) arg : NULL;
+			argv[p.we_wordc + 1] = NULL;
+		
+			// Child process could not be run, exit like the shell would
+			execvp(argv[0], argv);
+			_exit(127);
 		}
 
-		wordexp_t p;
-		if (wordexp(cmd, &p, 0) != 0)
+		// parent: the current command now owns these pipe ends
+		if (i > 0)
 		{
-			_exit(-1);
+			close(prev);
 		}
-	
-		// Child process could not be run (errno has more info)	
-		if (execvp(p.we_wordv[0], p.we_wordv) == -1)
+		if (!last)
 		{
-			_exit(-1);
+			close(next[1]);
+			stages[started++] = pid;
 		}
-		_exit(1);
+		prev = next[0];
 	}
-	else // parent
+
+	if (pid == -1)
 	{
-		if (in)
+		if (prev != pipe_stdin[0])
+		{
+			close(prev);
+		}
+		// stages already started won't be tracked by anyone, end them here
+		for (int i = 0; i < started; ++i)
 		{
-			close(pipe_stdin[0]);  // parent doesn't need read end
-			*in = fdopen(pipe_stdin[1], "w");
+			kill(stages[i], SIGKILL);
+			waitpid(stages[i], NULL, 0);
 		}
-		if (out)
+		for (int i = 0; i < KITA_MAX_STAGES - 1; ++i)
 		{
-			close(pipe_stdout[1]); // parent doesn't need write end
-			*out = fdopen(pipe_stdout[0], "r");
+			stages[i] = 0;
 		}
-		if (err)
+		for (int i = 0; i < 2; ++i)
 		{
-			close(pipe_stderr[1]); // parent doesn't need write end
-			*err = fdopen(pipe_stderr[0], "r");
+			if (pipe_stdin[i]  != -1) close(pipe_stdin[i]);
+			if (pipe_stdout[i] != -1) close(pipe_stdout[i]);
+			if (pipe_stderr[i] != -1) close(pipe_stderr[i]);
 		}
-		return pid;
+		free(pipeline);
+		return -1;
+	}
+
+	// parent doesn't need the child's ends of the pipes
+	for (int i = num_cmds - 1; i < KITA_MAX_STAGES - 1; ++i)
+	{
+		stages[i] = 0;
+	}
+	if (in)
+	{
+		close(pipe_stdin[0]);
+		*in = fdopen(pipe_stdin[1], "w");
+	}
+	if (out)
+	{
+		close(pipe_stdout[1]);
+		*out = fdopen(pipe_stdout[0], "r");
+	}
+	if (err)
+	{
+		close(pipe_stderr[1]);
+		*err = fdopen(pipe_stderr[0], "r");
 	}
+	free(pipeline);
+	return pid;
+
 }
 
 /*
@@ -370,16 +569,50 @@ libkita_child_has_fd(kita_child_s *child, int fd)
 }
 
 /*
- * Finds and returns the child with the given `pid` or NULL.
+ * Returns the index of `pid` in the child's pipeline stages or -1.
+ */
+static int
+libkita_child_get_stage(kita_child_s *child, pid_t pid)
+{
+	for (int i = 0; i < KITA_MAX_STAGES - 1; ++i)
+	{
+		if (child->stages[i] && child->stages[i] == pid)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Returns the number of the child's pipeline stages that haven't been reaped 
+ * yet, not counting the last stage (the child's main PID).
+ */
+static int
+libkita_child_num_stages(kita_child_s *child)
+{
+	int num = 0;
+	for (int i = 0; i < KITA_MAX_STAGES - 1; ++i)
+	{
+		num += child->stages[i] != 0;
+	}
+	return num;
+}
+
+/*
+ * Finds and returns the child with the given `pid` or NULL. For pipelines, 
+ * this will find the child via the PID of any of its stages.
  */
 static kita_child_s*
 libkita_child_get_by_pid(kita_state_s *state, pid_t pid)
 {
 	for (size_t i = 0; i < state->num_children; ++i)
 	{	
-		if (state->children[i]->pid == pid)
+		kita_child_s *child = state->children[i];
+		if ((child->pid == pid && !child->exited) ||
+		    libkita_child_get_stage(child, pid) != -1)
 		{
-			return state->children[i];
+			return child;
 		}
 	}
 	return NULL;
@@ -399,6 +632,19 @@ libkita_child_get_by_fd(kita_state_s *state, int fd)
 	return NULL;
 }
 
+static kita_watch_s*
+libkita_watch_get_by_fd(kita_state_s *state, int fd)
+{
+	for (size_t i = 0; i < state->num_watches; ++i)
+	{
+		if (state->watches[i]->fd == fd)
+		{
+			return state->watches[i];
+		}
+	}
+	return NULL;
+}
+
 /*
  * Find the index (array position) of the given child.
  * Returns the index position or -1 if no such child found.
@@ -623,22 +869,13 @@ libkita_child_open(kita_child_s *child)
 		return -1;
 	}
 
-	// Construct the command, if there is an additional argument string
-	char *cmd = NULL;
-	if (child->arg)
-	{
-		size_t len = strlen(child->cmd) + strlen(child->arg) + 4;
-		cmd = malloc(sizeof(char) * len);
-		snprintf(cmd, len, "%s %s", child->cmd, child->arg);
-	}
-	
-	// Execute the block and retrieve its PID
+	// Execute the block and retrieve its PID; the additional argument 
+	// string, if any, is passed on as a single argument, never parsed
 	child->pid = libkita_popen(
-			cmd ? cmd : child->cmd, 
+			child->cmd, child->arg, child->stages,
 			child->io[KITA_IOS_IN]  ? &child->io[KITA_IOS_IN]->fp  : NULL,
 			child->io[KITA_IOS_OUT] ? &child->io[KITA_IOS_OUT]->fp : NULL,
 		        child->io[KITA_IOS_ERR] ? &child->io[KITA_IOS_ERR]->fp : NULL);
-	free(cmd);
 
 	// Check if that worked
 	if (child->pid == -1)
@@ -816,10 +1053,44 @@ libkita_child_status(kita_child_s *child)
 	return 0;
 }
 
+/*
+ * Dispatches the READOK event for the child's stdout and stderr streams if
+ * they have data available for reading. Used before closing the streams of 
+ * a child that has exited, as it might have done so before the data has been
+ * read: short-lived commands (and pipelines) are often reaped before epoll 
+ * reports their output.
+ */
+static void
+libkita_child_drain(kita_state_s *state, kita_child_s *child)
+{
+	for (int i = KITA_IOS_OUT; i <= KITA_IOS_ERR; ++i)
+	{
+		kita_stream_s *stream = child->io[i];
+		if (stream == NULL || stream->fp == NULL)
+		{
+			continue;
+		}
+
+		int avail = libkita_fd_data_avail(stream->fd);
+		if (avail > 0)
+		{
+			kita_event_s event = { 0 };
+			event.type  = KITA_EVT_CHILD_READOK;
+			event.child = child;
+			event.fd    = stream->fd;
+			event.ios   = (kita_ios_type_e) i;
+			event.size  = avail;
+			libkita_dispatch_event(state, &event);
+		}
+	}
+}
+
 /*
  * Uses waitpid() to identify children that have died. Dead children will be 
  * closed (by closing all of their streams) and their PID will be reset to 0. 
  * The REAPED event will be dispatched for each child reaped this way.
+ * Pipelines are only reaped once all of their stages have exited, with the
+ * last stage's status as the child's status.
  * Returns the number of reaped children.
  */
 static int
@@ -838,8 +1109,27 @@ libkita_reap(kita_state_s *state)
 		kita_child_s *child = libkita_child_get_by_pid(state, pid);
 		if (child)
 		{
-			// remember the child's waitpid status
-			child->status = status;
+			int stage = libkita_child_get_stage(child, pid);
+			if (stage != -1)
+			{
+				child->stages[stage] = 0;
+			}
+			else
+			{
+				// remember the child's waitpid status
+				child->status = status;
+				child->exited = 1;
+			}
+
+			// pipeline isn't done yet
+			if (!child->exited || libkita_child_num_stages(child))
+			{
+				continue;
+			}
+
+			// hand out output that hasn't been read yet, as it 
+			// would be lost once we close the child's streams
+			libkita_child_drain(state, child);
 
 			// remove epoll events
 			libkita_child_rem_events(state, child);
@@ -862,6 +1152,7 @@ libkita_reap(kita_state_s *state)
 
 			// finally, set the PID to 0
 			child->pid = 0;
+			child->exited = 0;
 
 			++reaped;
 		}
@@ -925,13 +1216,57 @@ libkita_autoterm(kita_state_s *state)
 	return terminated;
 }
 
+/*
+ * Dispatches the appropriate event for activity on a watched file descriptor.
+ * Watches are level-triggered, so the user is expected to read all data from 
+ * the file descriptor in the READOK callback, or remove the watch on HANGUP.
+ */
+static int
+libkita_handle_watch_event(kita_state_s *state, kita_watch_s *watch, struct epoll_event *epev)
+{
+	kita_event_s event = { 0 };
+	event.watch = watch;
+	event.fd    = watch->fd;
+	event.ios   = KITA_IOS_NONE;
+
+	// EPOLLIN: We've got data coming in
+	if (epev->events & EPOLLIN)
+	{
+		event.type = KITA_EVT_WATCH_READOK;
+		event.size = libkita_fd_data_avail(event.fd);
+		libkita_dispatch_event(state, &event);
+		return 0;
+	}
+
+	// EPOLLOUT: Ready to be written to (only if requested, see kita_watch_set_feed)
+	// The READOK callback might have freed the watch, hence not both at once;
+	// as watches are level-triggered, we'll be told again on the next tick
+	if (epev->events & EPOLLOUT)
+	{
+		event.type = KITA_EVT_WATCH_FEEDOK;
+		libkita_dispatch_event(state, &event);
+		return 0;
+	}
+
+	// EPOLLHUP, EPOLLERR: Hung up or broken, nothing left to read
+	if (epev->events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR))
+	{
+		event.type = KITA_EVT_WATCH_HANGUP;
+		libkita_dispatch_event(state, &event);
+		return 0;
+	}
+
+	return 0;
+}
+
 static int
 libkita_handle_event(kita_state_s *state, struct epoll_event *epev)
 {
 	kita_child_s *child = libkita_child_get_by_fd(state, epev->data.fd);
 	if (child == NULL)
 	{
-		return 0;
+		kita_watch_s *watch = libkita_watch_get_by_fd(state, epev->data.fd);
+		return watch ? libkita_handle_watch_event(state, watch, epev) : 0;
 	}
 
 	kita_event_s event = { 0 };
@@ -1018,8 +1353,9 @@ libkita_stream_free(kita_stream_s** stream)
 }
 
 /*
- * TODO - currently we only ever get the last line, regardles of `last`
- *      - error handling for getline() (EOF, error) 
+ * Reads all lines available. If `last` is set, only the last line is returned,
+ * otherwise all lines are returned, still separated by newline characters.
+ * TODO - error handling for getline() (EOF, error) 
  */
 static char*
 libkita_stream_read_line(kita_stream_s *stream, int last, int no_nl)
@@ -1054,21 +1390,32 @@ libkita_stream_read_line(kita_stream_s *stream, int last, int no_nl)
 	size_t num_lines = 0;
 	size_t len = libkita_fd_data_avail(stream->fd) + 2;
 	char*  buf = malloc(len * sizeof(char));
+	size_t off = 0;
+	buf[0] = '\0';
 	
 	// fgets() - reads until a newline ('\n') or EOF (end of file)
 	//         - returns NULL on error or when EOF occurs
-	while (fgets(buf, len, stream->fp) != NULL)
+	// if we want all lines, we append each line to the previous ones
+	while (off < len - 1 && fgets(buf + off, len - off, stream->fp) != NULL)
 	{
 		++num_lines;
+		if (!last)
+		{
+			off += strlen(buf + off);
+		}
 	}
 
 	// remove trailing newline, if requested
-	if (no_nl)
+	if (no_nl && last)
 	{
 		buf[strcspn(buf, "\n")] = 0;
 	}
+	else if (no_nl && off > 0 && buf[off - 1] == '\n')
+	{
+		buf[off - 1] = 0;
+	}
 
-	// return the last line we read
+	// return the last line we read (or all of them)
 	return buf;
 }
 
@@ -1130,8 +1477,11 @@ libkita_poll(kita_state_s *s, int timeout)
 	// the signals that are ignored by default. For a list of signals:
 	// https://en.wikipedia.org/wiki/Signal_(IPC)
 	
+	// Note that epoll_pwait() replaces the signal mask while waiting, so we 
+	// start out with the current mask, as to not unblock signals that user 
+	// code might have blocked on purpose (for example, to use a signalfd).
 	sigset_t sigset;
-	sigemptyset(&sigset);
+	sigprocmask(SIG_SETMASK, NULL, &sigset);
 	sigaddset(&sigset, SIGCHLD);  // default: ignore
 	sigaddset(&sigset, SIGCONT);  // default: continue execution
 	sigaddset(&sigset, SIGURG);   // default: ignore
@@ -1202,6 +1552,12 @@ kita_child_is_alive(kita_child_s *child)
 	{
 		return 0;
 	}
+
+	// last stage of a pipeline has exited, but other stages haven't yet
+	if (child->exited)
+	{
+		return 1;
+	}
 	
 	// TODO this can return -1 if waitid() failed, in which
 	//      case we don't know if child is dead or alive...
@@ -1213,6 +1569,7 @@ kita_child_is_alive(kita_child_s *child)
  * be closed (by closing all of its streams) and its PID will be reset to 0. 
  * Returns the PID of the reaped child, 0 if the child wasn't reaped or -1 if 
  * the call to waitpid() encountered an error (inspect errno for details).
+ * Pipelines are only reaped once all of their stages have exited.
  * Note: this function is for children that are _untracked_ (have not been 
  *       added to a state); it will do nothing if the given child is tracked. 
  *       Also, no events (neither CLOSED nor REAPED) will be dispatched.
@@ -1226,7 +1583,25 @@ kita_child_reap(kita_child_s *child)
 		return -1;
 	}
 
-	int pid = waitpid(child->pid, &child->status, WNOHANG);
+	// reap the other stages of a pipeline, if any
+	for (int i = 0; i < KITA_MAX_STAGES - 1; ++i)
+	{
+		if (child->stages[i] && waitpid(child->stages[i], NULL, WNOHANG) != 0)
+		{
+			child->stages[i] = 0;
+		}
+	}
+
+	int pid = child->exited ? child->pid : waitpid(child->pid, &child->status, WNOHANG);
+	if (child->pid == pid)
+	{
+		child->exited = 1;
+	}
+	if (child->pid == pid && libkita_child_num_stages(child))
+	{
+		// pipeline isn't done yet
+		return 0;
+	}
 	if (child->pid == pid)
 	{
 		// close the child's streams
@@ -1234,6 +1609,7 @@ kita_child_reap(kita_child_s *child)
 
 		// finally, set the PID to 0
 		child->pid = 0;
+		child->exited = 0;
 	}
 	return pid;
 }
@@ -1387,6 +1763,28 @@ kita_child_open(kita_child_s *child)
 	return 0;
 }
 
+/*
+ * Sends the signal `sig` to the child and, for pipelines, all of its stages 
+ * that are still running. Returns 0 on success, -1 on error.
+ */
+static int
+libkita_child_signal(kita_child_s *child, int sig)
+{
+	if (child->pid < 2)
+	{
+		return -1;
+	}
+
+	for (int i = 0; i < KITA_MAX_STAGES - 1; ++i)
+	{
+		if (child->stages[i] > 1)
+		{
+			kill(child->stages[i], sig);
+		}
+	}
+	return child->exited ? 0 : kill(child->pid, sig);
+}
+
 /*
  * Sends the SIGKILL signal to the child. SIGKILL can not be ignored 
  * and leads to immediate shut-down of the child process, no clean-up.
@@ -1403,7 +1801,7 @@ kita_child_kill(kita_child_s *child)
 	// We do not set the child's PID to 0 here, because it seems
 	// like the better approach to detect all child deaths via 
 	// waitpid() or some other means (same approach for all).
-	return kill(child->pid, SIGKILL);
+	return libkita_child_signal(child, SIGKILL);
 }
 
 /*
@@ -1423,7 +1821,7 @@ kita_child_term(kita_child_s *child)
 	// child might not immediately terminate (clean-up, etc). 
 	// Instead, we should catch SIGCHLD, then use waitpid()
 	// to determine the termination and to set PID to 0.
-	return kill(child->pid, SIGTERM);
+	return libkita_child_signal(child, SIGTERM);
 }
 
 /*
@@ -1468,6 +1866,30 @@ kita_child_read(kita_child_s *child, kita_ios_type_e ios)
 	return libkita_stream_read(child->io[ios], last, nonl);
 }
 
+/*
+ * Same as kita_child_read(), but for line buffered streams, all available lines
+ * will be returned, separated by '\n', regardless of the LAST_LINE option.
+ * Returns NULL on error or if there was no data available for reading.
+ */
+char*
+kita_child_read_lines(kita_child_s *child, kita_ios_type_e ios)
+{
+	if (ios != KITA_IOS_OUT && ios != KITA_IOS_ERR)
+	{
+		return NULL;
+	}
+
+	if (child->io[ios] == NULL) // no such stream
+	{
+		return NULL;
+	}
+
+	kita_state_s* state = child->state;
+	int nonl = state ? kita_get_option(state, KITA_OPT_NO_NEWLINE) : 0;
+
+	return libkita_stream_read(child->io[ios], 0, nonl);
+}
+
 /*
  * Writes the given `input` to the child's stdin stream.
  * Returns 0 on success, -1 on error.
@@ -1595,6 +2017,139 @@ kita_child_del(kita_state_s *state, kita_child_s *child)
 	return state->num_children > libkita_child_del(state, child) ? 0 : -1;
 }
 
+/*
+ * Dynamically allocates a kita watch for the file descriptor `fd` and returns 
+ * a pointer to it. The watch does not take ownership of the file descriptor; 
+ * closing it remains up to the user. Returns NULL if malloc() failed.
+ */
+kita_watch_s*
+kita_watch_new(int fd)
+{
+	kita_watch_s *watch = malloc(sizeof(kita_watch_s));
+	if (watch == NULL)
+	{
+		return NULL;
+	}
+
+	*watch = (kita_watch_s) { 0 };
+	watch->fd = fd;
+	return watch;
+}
+
+/*
+ * Adds the watch to the state and registers its file descriptor with the 
+ * state's epoll instance, so READOK and HANGUP events will be dispatched.
+ * Returns 0 on success, -1 on error.
+ */
+int
+kita_watch_add(kita_state_s *state, kita_watch_s *watch)
+{
+	// watch is already tracked (by this or another state)
+	if (watch->state)
+	{
+		return -1;
+	}
+
+	size_t new_size = (state->num_watches + 1) * sizeof(kita_watch_s*);
+	kita_watch_s **watches = realloc(state->watches, new_size);
+	if (watches == NULL)
+	{
+		return -1;
+	}
+	state->watches = watches;
+
+	struct epoll_event epev = { .events = EPOLLIN, .data.fd = watch->fd };
+	if (epoll_ctl(state->epfd, EPOLL_CTL_ADD, watch->fd, &epev) == -1)
+	{
+		return -1;
+	}
+
+	state->watches[state->num_watches++] = watch;
+	watch->state = state;
+	return 0;
+}
+
+/*
+ * Removes the watch from the state and unregisters its file descriptor from 
+ * the state's epoll instance. The file descriptor will not be closed.
+ * Returns 0 on success, -1 on error.
+ */
+int
+kita_watch_del(kita_state_s *state, kita_watch_s *watch)
+{
+	if (watch->state != state)
+	{
+		return -1;
+	}
+
+	for (size_t i = 0; i < state->num_watches; ++i)
+	{
+		if (state->watches[i] != watch)
+		{
+			continue;
+		}
+
+		epoll_ctl(state->epfd, EPOLL_CTL_DEL, watch->fd, NULL);
+
+		// copy the last element into this slot, array shrinks by one
+		state->watches[i] = state->watches[--state->num_watches];
+		state->watches[state->num_watches] = NULL;
+		watch->state = NULL;
+		return 0;
+	}
+	return -1;
+}
+
+/*
+ * Removes the watch from its state, if any, then frees it and sets it to NULL.
+ */
+void
+kita_watch_free(kita_watch_s **watch)
+{
+	kita_watch_s *w = *watch;
+
+	if (w->state)
+	{
+		kita_watch_del(w->state, w);
+	}
+
+	free(w);
+	*watch = NULL;
+}
+
+void
+kita_watch_set_context(kita_watch_s *watch, void *ctx)
+{
+	watch->ctx = ctx;
+}
+
+void*
+kita_watch_get_context(kita_watch_s *watch)
+{
+	return watch->ctx;
+}
+
+/*
+ * Enables or disables KITA_EVT_WATCH_FEEDOK events for the given watch, which 
+ * needs to be added to a state already. Only enable these while you actually 
+ * have data waiting to be written, as they will fire for as long as the fd 
+ * is writable. Returns 0 on success, -1 on error.
+ */
+int
+kita_watch_set_feed(kita_watch_s *watch, int feed)
+{
+	if (watch->state == NULL)
+	{
+		return -1;
+	}
+
+	struct epoll_event epev = { 
+		.events = EPOLLIN | (feed ? EPOLLOUT : 0), 
+		.data.fd = watch->fd 
+	};
+	return epoll_ctl(watch->state->epfd, EPOLL_CTL_MOD, watch->fd, &epev);
+}
+
 /*
  * Returns the option specified by `opt`, either 0 or 1.
  * If the specified option doesn't exist, -1 is returned.
@@ -1704,6 +2259,13 @@ kita_free(kita_state_s** state)
 		kita_child_free(&(*state)->children[i]);
 	}
 
+	while ((*state)->num_watches)
+	{
+		kita_watch_s *watch = (*state)->watches[0];
+		kita_watch_free(&watch);
+	}
+	free((*state)->watches);
+
 	free(*state);
 	*state = NULL;
 }
@@ -44,6 +44,11 @@ int lemon_ini_handler(void *data, const char *section, const char *name, const c
 		cfg_set_str(lc, LEMON_OPT_SEPARATOR, is_quoted(value) ? unquote(value) : strdup(value));
 		return 1;
 	}
+	if (equals(name, "shell"))
+	{
+		cfg_set_str(lc, LEMON_OPT_SHELL, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
 	if (equals(name, "height") || equals(name, "h"))
 	{
 		cfg_set_int(lc, LEMON_OPT_HEIGHT, atoi(value));
@@ -250,12 +255,156 @@ int block_ini_handler(void *data, const char *section, const char *name, const c
 		cfg_set_int(bc, BLOCK_OPT_CONSUME, equals(value, "true"));
 		return 1;
 	}
+	if (equals(name, "debounce"))
+	{
+		cfg_set_float(bc, BLOCK_OPT_DEBOUNCE, atof(value));
+		return 1;
+	}
+	if (equals(name, "trigger-match"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_TRIG_MATCH, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "trigger-ignore"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_TRIG_IGNORE, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "trigger-distinct"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_TRIG_DISTINCT, equals(value, "true"));
+		return 1;
+	}
 	if (equals(name, "live"))
 	{
 		block->b_type = BLOCK_LIVE;
 		cfg_set_int(bc, BLOCK_OPT_LIVE, equals(value, "true"));
 		return 1;
 	}
+	if (equals(name, "push"))
+	{
+		block->b_type = BLOCK_PUSH;
+		cfg_set_str(bc, BLOCK_OPT_PUSH, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "multiplex"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_MULTIPLEX, equals(value, "true"));
+		return 1;
+	}
+	if (equals(name, "source"))
+	{
+		block->b_type = BLOCK_SOURCED;
+		cfg_set_str(bc, BLOCK_OPT_SOURCE, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "field"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_FIELD, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "script"))
+	{
+		// continuation lines of multi-line values arrive as repeated keys
+		char *line = is_quoted(value) ? unquote(value) : strdup(value);
+		char *prev = cfg_get_str(bc, BLOCK_OPT_SCRIPT);
+		if (prev)
+		{
+			size_t len = strlen(prev) + strlen(line) + 2;
+			char *script = malloc(len);
+			snprintf(script, len, "%s\n%s", prev, line);
+			free(prev);
+			free(line);
+			line = script;
+		}
+		cfg_set_str(bc, BLOCK_OPT_SCRIPT, line);
+		return 1;
+	}
+	if (equals(name, "mode"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_SHELL, equals(value, "shell"));
+		return 1;
+	}
+	if (equals(name, "persistent"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_PERSISTENT, equals(value, "true"));
+		return 1;
+	}
+	if (equals(name, "split"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_SPLIT, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "regex-capture"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_REGEX, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "tr"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_TR, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "trim"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_TRIM, equals(value, "true"));
+		return 1;
+	}
+	if (equals(name, "max-length"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_MAX_LENGTH, atoi(value));
+		return 1;
+	}
+	if (equals(name, "map"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_MAP, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "format"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_FORMAT, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "foreground-if"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_FG_IF, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "background-if"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_BG_IF, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "label-if"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_LABEL_IF, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "signal"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_SIGNAL, atoi(value));
+		return 1;
+	}
+	if (equals(name, "run-if-changed"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_IF_CHANGED, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "run-if-exists"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_IF_EXISTS, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "run-if-missing"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_IF_MISSING, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "run-if-output"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_IF_OUTPUT, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
 	if (equals(name, "raw"))
 	{
 		cfg_set_int(bc, BLOCK_OPT_RAW, equals(value, "true"));
@@ -0,0 +1,296 @@
+#include <stdio.h>     // fprintf(), snprintf()
+#include <stdlib.h>    // malloc(), free()
+#include <string.h>    // strlen(), strcspn(), strdup()
+#include <stdint.h>    // uint64_t
+#include <unistd.h>    // write()
+#include <dlfcn.h>     // dlopen(), dlsym(), dlclose()
+#include <pthread.h>   // pthread_create(), pthread_mutex_lock(), ...
+#include <signal.h>    // sigfillset(), pthread_sigmask()
+#include "succade.h"   // thing_s, plugin_s
+
+//
+// PLUGINS
+//
+// Blocks with a command of the form `plugin:/path/foo.so [args]` are provided
+// by a shared object, see succade-plugin.h for the ABI. The plugin's functions
+// are called from a small pool of worker threads, so a slow plugin can't hold
+// up the main loop. Workers signal the main loop via an eventfd whenever a
+// plugin has published output or returned from poll(); the main loop then
+// collects the results from the plugin block.
+//
+
+struct plugin_job
+{
+	plugin_s *plugin;
+	char     *input;         // consumed trigger output for poll(), or NULL
+	int       button;        // mouse button for click(), 0 for poll()
+};
+
+static struct
+{
+	pthread_t       threads[PLUGIN_WORKERS];
+	size_t          num_threads;
+	pthread_mutex_t lock;    // guards everything below
+	pthread_cond_t  cond;    // signalled when a job has been queued or on stop
+	struct plugin_job jobs[PLUGIN_QUEUE]; // ring buffer of pending jobs
+	size_t          head;    // index of the next job to run
+	size_t          len;     // number of pending jobs
+	unsigned char   stop : 1;// are the workers supposed to exit?
+	int             efd;     // eventfd to notify the main loop, or -1
+}
+plugin_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.efd  = -1
+};
+
+/*
+ * Wakes up the main loop by incrementing the eventfd's counter, if any.
+ */
+static void notify_plugins()
+{
+	uint64_t one = 1;
+	if (plugin_pool.efd != -1 && write(plugin_pool.efd, &one, sizeof(one)) == -1)
+	{
+		// the counter can only overflow if nobody reads it, nothing to do
+	}
+}
+
+/*
+ * Publish callback handed to the plugins, see succade_publish_fn.
+ */
+static void plugin_publish(void *handle, const char *output)
+{
+	plugin_s *plugin = handle;
+
+	pthread_mutex_lock(&plugin->lock);
+	snprintf(plugin->pending, sizeof(plugin->pending), "%s", output ? output : "");
+	plugin->published = 1;
+	pthread_mutex_unlock(&plugin->lock);
+
+	notify_plugins();
+}
+
+static void run_job(struct plugin_job *job)
+{
+	plugin_s *plugin = job->plugin;
+
+	pthread_mutex_lock(&plugin->run);
+	if (job->button)
+	{
+		plugin->api->click(plugin->ctx, job->button);
+		pthread_mutex_unlock(&plugin->run);
+		return;
+	}
+	double next = plugin->api->poll(plugin->ctx, job->input);
+	pthread_mutex_unlock(&plugin->run);
+
+	// negative (or NaN) return values mean the same as 0, no need to call
+	pthread_mutex_lock(&plugin->lock);
+	plugin->next = next > 0.0 ? next : 0.0;
+	plugin->polled = 1;
+	pthread_mutex_unlock(&plugin->lock);
+
+	notify_plugins();
+}
+
+static void *plugin_worker(void *arg)
+{
+	pthread_mutex_lock(&plugin_pool.lock);
+	while (1)
+	{
+		while (plugin_pool.len == 0 && !plugin_pool.stop)
+		{
+			pthread_cond_wait(&plugin_pool.cond, &plugin_pool.lock);
+		}
+		if (plugin_pool.stop)
+		{
+			break;
+		}
+
+		struct plugin_job job = plugin_pool.jobs[plugin_pool.head];
+		plugin_pool.head = (plugin_pool.head + 1) % PLUGIN_QUEUE;
+		plugin_pool.len -= 1;
+
+		pthread_mutex_unlock(&plugin_pool.lock);
+		run_job(&job);
+		free(job.input);
+		pthread_mutex_lock(&plugin_pool.lock);
+	}
+	pthread_mutex_unlock(&plugin_pool.lock);
+	return NULL;
+}
+
+/*
+ * Starts `num` worker threads (but at most PLUGIN_WORKERS), which will notify
+ * the main loop via the eventfd `efd`. Returns the number of threads started.
+ */
+static size_t start_workers(int efd, size_t num)
+{
+	plugin_pool.efd = efd;
+	plugin_pool.stop = 0;
+
+	// workers inherit our signal mask; make sure signals go to the main loop
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	num = num > PLUGIN_WORKERS ? PLUGIN_WORKERS : num;
+	while (plugin_pool.num_threads < num)
+	{
+		pthread_t *thread = &plugin_pool.threads[plugin_pool.num_threads];
+		if (pthread_create(thread, NULL, plugin_worker, NULL) != 0)
+		{
+			break;
+		}
+		plugin_pool.num_threads += 1;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return plugin_pool.num_threads;
+}
+
+/*
+ * Makes all worker threads exit and waits for them to do so. Jobs that
+ * haven't been started yet are dropped. Afterwards, no plugin functions
+ * will be called anymore, except by the main thread.
+ */
+static void stop_workers()
+{
+	pthread_mutex_lock(&plugin_pool.lock);
+	plugin_pool.stop = 1;
+	pthread_cond_broadcast(&plugin_pool.cond);
+	pthread_mutex_unlock(&plugin_pool.lock);
+
+	for (size_t i = 0; i < plugin_pool.num_threads; ++i)
+	{
+		pthread_join(plugin_pool.threads[i], NULL);
+	}
+	plugin_pool.num_threads = 0;
+
+	for (; plugin_pool.len; --plugin_pool.len)
+	{
+		free(plugin_pool.jobs[plugin_pool.head].input);
+		plugin_pool.head = (plugin_pool.head + 1) % PLUGIN_QUEUE;
+	}
+	plugin_pool.efd = -1;
+}
+
+/*
+ * Queues a call to the plugin's poll() (if `button` is 0) or click() function.
+ * `input` will be copied. Returns 0 on success, -1 if the queue is full or the
+ * plugin doesn't handle clicks.
+ */
+static int queue_plugin(plugin_s *plugin, const char *input, int button)
+{
+	if (button && plugin->api->click == NULL)
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&plugin_pool.lock);
+	if (plugin_pool.len == PLUGIN_QUEUE || plugin_pool.num_threads == 0)
+	{
+		pthread_mutex_unlock(&plugin_pool.lock);
+		return -1;
+	}
+
+	size_t tail = (plugin_pool.head + plugin_pool.len) % PLUGIN_QUEUE;
+	plugin_pool.jobs[tail] = (struct plugin_job) {
+		.plugin = plugin,
+		.input  = input ? strdup(input) : NULL,
+		.button = button
+	};
+	plugin_pool.len += 1;
+	pthread_cond_signal(&plugin_pool.cond);
+	pthread_mutex_unlock(&plugin_pool.lock);
+	return 0;
+}
+
+/*
+ * Fetches the results the plugin has produced since the last call: if it
+ * has published output, copies it to `buf` and returns 1 (otherwise 0).
+ * If poll() has returned, sets `next` to its return value, otherwise to -1.
+ */
+static int collect_plugin(plugin_s *plugin, char *buf, size_t len, double *next)
+{
+	pthread_mutex_lock(&plugin->lock);
+	int published = plugin->published;
+	if (published)
+	{
+		snprintf(buf, len, "%s", plugin->pending);
+	}
+	*next = plugin->polled ? plugin->next : -1.0;
+	plugin->published = 0;
+	plugin->polled = 0;
+	pthread_mutex_unlock(&plugin->lock);
+	return published;
+}
+
+/*
+ * Calls the plugin's free() function, unloads it and frees the plugin block.
+ * Must only be called once the workers have been stopped.
+ */
+static void free_plugin(plugin_s *plugin)
+{
+	if (plugin->api->free)
+	{
+		plugin->api->free(plugin->ctx);
+	}
+	dlclose(plugin->dl);
+	pthread_mutex_destroy(&plugin->run);
+	pthread_mutex_destroy(&plugin->lock);
+	free(plugin);
+}
+
+/*
+ * Loads the plugin specified in `spec` for the given block, where `spec` has
+ * the format `path [args]`, as found after the `plugin:` prefix in the block's
+ * command, and calls the plugin's init(). Returns 0 on success, -1 on error.
+ */
+static int load_plugin(thing_s *block, const char *spec)
+{
+	size_t path_len = strcspn(spec, " ");
+	char path[path_len + 1];
+	snprintf(path, path_len + 1, "%s", spec);
+	const char *args = spec + path_len + strspn(spec + path_len, " ");
+
+	void *dl = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (dl == NULL)
+	{
+		fprintf(stderr, "%s\n", dlerror());
+		return -1;
+	}
+
+	const struct succade_plugin *api = dlsym(dl, "succade_plugin");
+	if (api == NULL || api->abi != SUCCADE_PLUGIN_ABI || api->poll == NULL)
+	{
+		fprintf(stderr, "Not a succade plugin or wrong ABI version: %s\n", path);
+		dlclose(dl);
+		return -1;
+	}
+
+	plugin_s *plugin = malloc(sizeof(plugin_s));
+	if (plugin == NULL)
+	{
+		dlclose(dl);
+		return -1;
+	}
+
+	*plugin = (plugin_s) { .dl = dl, .api = api };
+	pthread_mutex_init(&plugin->run, NULL);
+	pthread_mutex_init(&plugin->lock, NULL);
+
+	plugin->ctx = api->init ? api->init(args, plugin_publish, plugin) : NULL;
+	if (api->init && plugin->ctx == NULL)
+	{
+		pthread_mutex_destroy(&plugin->run);
+		pthread_mutex_destroy(&plugin->lock);
+		dlclose(dl);
+		free(plugin);
+		return -1;
+	}
+
+	block->plugin = plugin;
+	return 0;
+}
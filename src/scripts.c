@@ -0,0 +1,367 @@
+#include <stdio.h>     // fprintf(), snprintf()
+#include <stdlib.h>    // malloc(), free()
+#include <string.h>    // strlen()
+#include <fcntl.h>     // open(), O_RDONLY
+#include <unistd.h>    // read(), close()
+#include "succade.h"   // thing_s, state_s, builtin_s
+
+//
+// SCRIPT BLOCKS
+//
+// Blocks with a `script` option run a snippet of Lua within succade's own
+// process, instead of a command. The snippet's return value becomes the
+// block's output; an optional second return value is the number of seconds
+// after which the block wants to be run again; anything but a string, a number
+// or nil is an error. Each block has its own global environment, which persists
+// between runs, with its own copies of the library tables, so scripts can't 
+// break each other. Every run is limited to SCRIPT_BUDGET VM instructions and
+// all scripts together to SCRIPT_MEMORY bytes. Besides Lua's base, string, 
+// table, math and utf8 libraries, scripts can use:
+//
+//   input          consumed trigger output, or nil
+//   read(path)     contents of the file (up to BUFFER_SCRIPT_READ bytes), or nil
+//   output(name)   current output of the block `name`, or nil
+//
+// Script blocks are driven by the built-in block machinery, see builtins.c.
+// All blocks share one Lua state, which only exists while there are script
+// blocks. Only available if succade has been compiled with SUCCADE_LUA.
+//
+
+#ifdef SUCCADE_LUA
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+struct script
+{
+	int func;                // registry reference to the compiled script
+	int env;                 // registry reference to the block's environment
+};
+
+static lua_State *script_lua;   // shared by all script blocks
+static size_t     script_count; // number of blocks using script_lua
+static size_t     script_mem;   // bytes currently allocated by script_lua
+
+/*
+ * Allocator for the shared Lua state that refuses to grow beyond SCRIPT_MEMORY
+ * bytes in total, which makes Lua raise a memory error in the offending script.
+ */
+static void *script_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+	// if `ptr` is NULL, `osize` is the type of object to allocate, not a size
+	size_t used = ptr ? osize : 0;
+	if (nsize == 0)
+	{
+		free(ptr);
+		script_mem -= used;
+		return NULL;
+	}
+	if (nsize > used && nsize - used > SCRIPT_MEMORY - script_mem)
+	{
+		return NULL;
+	}
+
+	void *mem = realloc(ptr, nsize);
+	if (mem)
+	{
+		script_mem = script_mem - used + nsize;
+	}
+	return mem;
+}
+
+/*
+ * Count hook that aborts scripts which have used up their budget. From then on,
+ * every instruction fails, so the error can't be caught with pcall() forever.
+ */
+static void script_hook(lua_State *lua, lua_Debug *ar)
+{
+	lua_sethook(lua, script_hook, LUA_MASKCOUNT, 1);
+	luaL_error(lua, "instruction budget exceeded");
+}
+
+/*
+ * Called on errors outside of protected calls, right before Lua aborts.
+ */
+static int script_panic(lua_State *lua)
+{
+	fprintf(stderr, "script_panic(): %s\n", lua_type(lua, -1) == LUA_TSTRING ? lua_tostring(lua, -1) : "unknown error");
+	return 0;
+}
+
+/*
+ * read(path): returns the contents of the file, or nil.
+ */
+static int script_read(lua_State *lua)
+{
+	const char *path = luaL_checkstring(lua, 1);
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		lua_pushnil(lua);
+		return 1;
+	}
+
+	char buf[BUFFER_SCRIPT_READ];
+	ssize_t len = read(fd, buf, sizeof(buf));
+	close(fd);
+
+	if (len == -1)
+	{
+		lua_pushnil(lua);
+		return 1;
+	}
+	lua_pushlstring(lua, buf, len);
+	return 1;
+}
+
+/*
+ * output(name): returns the current output of the named block, or nil.
+ */
+static int script_output(lua_State *lua)
+{
+	const state_s *state = lua_touserdata(lua, lua_upvalueindex(1));
+	const char *name = luaL_checkstring(lua, 1);
+
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		if (equals(state->blocks[i].sid, name) && state->blocks[i].output)
+		{
+			lua_pushstring(lua, state->blocks[i].output);
+			return 1;
+		}
+	}
+	lua_pushnil(lua);
+	return 1;
+}
+
+/*
+ * Creates the shared Lua state with the safe subset of the standard libraries
+ * and our own functions. Returns 0 on success, -1 on error.
+ */
+static int open_lua(state_s *state)
+{
+	script_lua = lua_newstate(script_alloc, NULL);
+	if (script_lua == NULL)
+	{
+		return -1;
+	}
+	lua_atpanic(script_lua, script_panic);
+
+	luaL_requiref(script_lua, LUA_GNAME,       luaopen_base,   1);
+	luaL_requiref(script_lua, LUA_STRLIBNAME,  luaopen_string, 1);
+	luaL_requiref(script_lua, LUA_TABLIBNAME,  luaopen_table,  1);
+	luaL_requiref(script_lua, LUA_MATHLIBNAME, luaopen_math,   1);
+	luaL_requiref(script_lua, LUA_UTF8LIBNAME, luaopen_utf8,   1);
+	lua_pop(script_lua, 5);
+
+	// scripts can only read files via read(), only load source code and
+	// can't stop or tune the garbage collector, which all of them share
+	const char *unsafe[] = { "dofile", "loadfile", "load", "collectgarbage" };
+	for (size_t i = 0; i < sizeof(unsafe) / sizeof(unsafe[0]); ++i)
+	{
+		lua_pushnil(script_lua);
+		lua_setglobal(script_lua, unsafe[i]);
+	}
+
+	lua_pushcfunction(script_lua, script_read);
+	lua_setglobal(script_lua, "read");
+	lua_pushlightuserdata(script_lua, state);
+	lua_pushcclosure(script_lua, script_output, 1);
+	lua_setglobal(script_lua, "output");
+
+	// strings index the shared string table, so don't let scripts get at it
+	lua_pushliteral(script_lua, "");
+	lua_getmetatable(script_lua, -1);
+	lua_pushboolean(script_lua, 0);
+	lua_setfield(script_lua, -2, "__metatable");
+	lua_pop(script_lua, 2);
+	return 0;
+}
+
+/*
+ * Pushes a new environment for a script block onto the stack: a copy of the 
+ * shared globals, where all tables (the libraries) are copied as well and `_G`
+ * refers to the new environment itself.
+ */
+static void push_env(lua_State *lua)
+{
+	lua_newtable(lua);
+	lua_pushglobaltable(lua);
+	lua_pushnil(lua);
+	while (lua_next(lua, -2))
+	{
+		// stack: env, _G, key, value
+		if (lua_istable(lua, -1))
+		{
+			lua_newtable(lua);
+			lua_pushnil(lua);
+			while (lua_next(lua, -3))
+			{
+				// stack: env, _G, key, lib, copy, libkey, libvalue
+				lua_pushvalue(lua, -2);
+				lua_insert(lua, -2);
+				lua_rawset(lua, -4);
+			}
+			lua_remove(lua, -2);
+		}
+		lua_pushvalue(lua, -2);
+		lua_insert(lua, -2);
+		lua_rawset(lua, -5);
+	}
+	lua_pop(lua, 1);
+
+	lua_pushvalue(lua, -1);
+	lua_setfield(lua, -2, LUA_GNAME);
+}
+
+/*
+ * Runs a script with everything that might allocate memory or run Lua code 
+ * protected, hence called via lua_pcall() with the script's function, its 
+ * environment and its input (light userdata, or nil). Sets the input, calls 
+ * the script and turns its output into a string. Returns the script's output
+ * and the time until it wants to be run next.
+ */
+static int script_call(lua_State *lua)
+{
+	// set raw, as the script might have given its environment a metatable
+	const char *input = lua_touserdata(lua, 3);
+	lua_pushliteral(lua, "input");
+	if (input)
+	{
+		lua_pushstring(lua, input);
+	}
+	else
+	{
+		lua_pushnil(lua);
+	}
+	lua_rawset(lua, 2);
+	lua_settop(lua, 1);
+
+	lua_call(lua, 0, 2);
+
+	// only accept strings and numbers, as anything else might have a 
+	// __tostring metamethod that would run outside of the budget
+	if (!lua_isnil(lua, -2) && !lua_isstring(lua, -2))
+	{
+		return luaL_error(lua, "returned a %s instead of a string", luaL_typename(lua, -2));
+	}
+	if (lua_isnumber(lua, -2))
+	{
+		lua_tostring(lua, -2); // converted in place
+	}
+	return 2;
+}
+
+static double script_run(thing_s *block, const char *input, char *buf, size_t len)
+{
+	struct script *script = block->data;
+	lua_State *lua = script_lua;
+
+	lua_pushcfunction(lua, script_call);
+	lua_rawgeti(lua, LUA_REGISTRYINDEX, script->func);
+	lua_rawgeti(lua, LUA_REGISTRYINDEX, script->env);
+	if (input)
+	{
+		lua_pushlightuserdata(lua, (void *) input);
+	}
+	else
+	{
+		lua_pushnil(lua);
+	}
+
+	lua_sethook(lua, script_hook, LUA_MASKCOUNT, SCRIPT_BUDGET);
+	int err = lua_pcall(lua, 3, 2, 0);
+	lua_sethook(lua, NULL, 0, 0);
+
+	if (err != LUA_OK)
+	{
+		fprintf(stderr, "Script of block '%s' failed: %s\n", block->sid, 
+				lua_type(lua, -1) == LUA_TSTRING ? lua_tostring(lua, -1) : "unknown error");
+		snprintf(buf, len, "%s", block->output ? block->output : "");
+		lua_settop(lua, 0);
+		return 0.0;
+	}
+
+	double next = lua_isnumber(lua, -1) ? lua_tonumber(lua, -1) : 0.0;
+	const char *out = lua_isnil(lua, -2) ? "" : lua_tostring(lua, -2);
+	snprintf(buf, len, "%s", out);
+	lua_settop(lua, 0);
+	return next;
+}
+
+static void script_free(thing_s *block)
+{
+	struct script *script = block->data;
+	if (script == NULL)
+	{
+		return;
+	}
+
+	luaL_unref(script_lua, LUA_REGISTRYINDEX, script->func);
+	luaL_unref(script_lua, LUA_REGISTRYINDEX, script->env);
+	free(script);
+
+	if (--script_count == 0)
+	{
+		lua_close(script_lua);
+		script_lua = NULL;
+	}
+}
+
+static const builtin_s script_builtin = { "script", NULL, script_run, script_free };
+
+/*
+ * Compiles the given block's script and sets the block up to run it, with its
+ * own global environment, see push_env(). Returns 0 on success, -1 on error.
+ */
+static int init_script(state_s *state, thing_s *block, const char *source)
+{
+	if (script_lua == NULL && open_lua(state) == -1)
+	{
+		return -1;
+	}
+
+	struct script *script = malloc(sizeof(struct script));
+	if (script == NULL)
+	{
+		return -1;
+	}
+
+	lua_State *lua = script_lua;
+	if (luaL_loadbufferx(lua, source, strlen(source), block->sid, "t") != LUA_OK)
+	{
+		fprintf(stderr, "Script of block '%s' failed to compile: %s\n", block->sid, lua_tostring(lua, -1));
+		lua_settop(lua, 0);
+		free(script);
+		if (script_count == 0)
+		{
+			lua_close(script_lua);
+			script_lua = NULL;
+		}
+		return -1;
+	}
+
+	// make env the script's _ENV (its first and only upvalue)
+	push_env(lua);
+	lua_pushvalue(lua, -1);
+	script->env = luaL_ref(lua, LUA_REGISTRYINDEX);
+	lua_setupvalue(lua, -2, 1);
+	script->func = luaL_ref(lua, LUA_REGISTRYINDEX);
+
+	block->data = script;
+	block->builtin = &script_builtin;
+	++script_count;
+	return 0;
+}
+
+#else
+
+static int init_script(state_s *state, thing_s *block, const char *source)
+{
+	fprintf(stderr, "Script blocks need succade to be built with SUCCADE_LUA\n");
+	return -1;
+}
+
+#endif
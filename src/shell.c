@@ -0,0 +1,317 @@
+#include <stdio.h>     // snprintf()
+#include <stdlib.h>    // malloc(), free()
+#include <string.h>    // strlen(), strncmp(), strdup()
+#include <signal.h>    // sigemptyset(), sigaddset(), sigtimedwait()
+#include <time.h>      // struct timespec
+#include <float.h>     // DBL_MAX
+#include <unistd.h>    // getpid()
+#include <sys/random.h> // getrandom()
+#include "succade.h"   // thing_s, shell_s, shell_job_s
+
+//
+// SHELL MODE
+//
+// Blocks with `mode = shell` don't get a process of their own for every run.
+// Instead, their command is handed to a persistent shell (the bar's `shell`
+// option, DEFAULT_SHELL if not given), which evaluates it in a subshell and
+// reports back the last line of its output. This saves starting the shell,
+// and whatever it does on start-up, for every run; sourcing a script, as in
+// `. ~/bin/volume`, saves starting the script's interpreter as well. Commands
+// are run one at a time, in the order they became due. Every response starts
+// with a token that is unique to the shell process and the request:
+//
+//   to shell:   __succade TOKEN 'command' ['input']
+//   from shell: TOKEN STATUS LAST-LINE-OF-OUTPUT
+//
+// A command that is still running after SHELL_TIMEOUT seconds gets the shell
+// killed. A shell that died is restarted once there are commands to run,
+// waiting longer after every failed attempt, see backoff_shell().
+//
+
+/*
+ * Defines the function that runs a command for us. The command can't read
+ * from the shell's stdin (our requests), nor end the shell via `exit`.
+ */
+static const char *shell_prelude =
+	"__succade_nl='\n'\n"
+	"__succade() {\n"
+	"\t__succade_o=$(__succade_c=$2; shift 2; eval \"$__succade_c\" < /dev/null 2> /dev/null)\n"
+	"\tprintf '%s %d %s\\n' \"$1\" \"$?\" \"${__succade_o##*$__succade_nl}\"\n"
+	"}\n";
+
+/*
+ * Copies `str` to `buf`, wrapped in single quotes, so that the shell will take
+ * it literally. `buf` needs room for 4 * strlen(str) + 3 bytes. Returns a
+ * pointer to the terminating null byte in `buf`.
+ */
+static char *shell_quote(char *buf, const char *str)
+{
+	*buf++ = '\'';
+	for (; *str; ++str)
+	{
+		if (*str == '\'')
+		{
+			memcpy(buf, "'\\''", 4);
+			buf += 4;
+		}
+		else
+		{
+			*buf++ = *str;
+		}
+	}
+	*buf++ = '\'';
+	*buf = '\0';
+	return buf;
+}
+
+/*
+ * Writes `str` to the child's stdin. SIGPIPE, should the child have died, is
+ * discarded instead of ending succade, see on_signal(). Also used for feeding
+ * persistent blocks. Returns 0 on success, -1 on error.
+ */
+static int feed_child(kita_child_s *child, const char *str)
+{
+	sigset_t pipe_set, old_set;
+	sigemptyset(&pipe_set);
+	sigaddset(&pipe_set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+	int fed = kita_child_feed(child, str);
+
+	struct timespec zero = { 0 };
+	while (sigtimedwait(&pipe_set, NULL, &zero) == SIGPIPE)
+	{
+		fed = -1;
+	}
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+	return fed;
+}
+
+/*
+ * Doubles the time to wait before the shell's next restart, starting at
+ * SHELL_BACKOFF_MIN and capped at SHELL_BACKOFF_MAX.
+ */
+static void backoff_shell(shell_s *shell)
+{
+	shell->backoff *= 2.0;
+	if (shell->backoff < SHELL_BACKOFF_MIN)
+	{
+		shell->backoff = SHELL_BACKOFF_MIN;
+	}
+	if (shell->backoff > SHELL_BACKOFF_MAX)
+	{
+		shell->backoff = SHELL_BACKOFF_MAX;
+	}
+}
+
+/*
+ * Starts the shell process, with a fresh token, and defines our function in it.
+ * Returns 0 on success, -1 on error.
+ */
+static int spawn_shell(shell_s *shell, double now)
+{
+	shell->spawned = now;
+	if (kita_child_open(shell->child) == -1)
+	{
+		return -1;
+	}
+	kita_child_set_buf_type(shell->child, KITA_IOS_IN, KITA_BUF_LINE);
+	shell->up = 1;
+
+	unsigned long nonce = 0;
+	if (getrandom(&nonce, sizeof(nonce), GRND_NONBLOCK) != sizeof(nonce))
+	{
+		nonce = (unsigned long) (now * 1000000.0) ^ (unsigned long) getpid();
+	}
+	snprintf(shell->token, sizeof(shell->token), "succade-%lx", nonce);
+
+	if (feed_child(shell->child, shell_prelude) == -1)
+	{
+		kita_child_kill(shell->child);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Adds the given block to the end of the shell's queue. `input` will be copied.
+ * Returns 0 on success, -1 if the queue is full.
+ */
+static int queue_shell(shell_s *shell, thing_s *block, const char *input)
+{
+	if (shell->len == shell->size)
+	{
+		return -1;
+	}
+
+	size_t tail = (shell->head + shell->len) % shell->size;
+	shell->jobs[tail] = (shell_job_s) {
+		.block = block,
+		.input = input ? strdup(input) : NULL
+	};
+	shell->len += 1;
+	return 0;
+}
+
+/*
+ * Sends the command of the next block in the queue to the shell, if the shell
+ * is up and not busy with another command. Returns the block whose command has
+ * been sent, or NULL. If sending failed, the block is dropped from the queue
+ * and the shell killed, as it's unlikely to be in a usable state.
+ */
+static thing_s *send_shell(shell_s *shell, double now)
+{
+	if (!shell->up || shell->block || shell->len == 0)
+	{
+		return NULL;
+	}
+
+	shell_job_s job = shell->jobs[shell->head];
+	shell->head = (shell->head + 1) % shell->size;
+	shell->len -= 1;
+
+	const char *bin = cfg_get_str(&job.block->cfg, BLOCK_OPT_BIN);
+	const char *cmd = bin ? bin : job.block->sid;
+	size_t len = BUFFER_SHELL_TOKEN + BUFFER_NUMERIC + 4 * strlen(cmd)
+		+ (job.input ? 4 * strlen(job.input) : 0) + 32;
+
+	char *req = malloc(len);
+	if (req == NULL)
+	{
+		free(job.input);
+		job.block->alive = 0;
+		return NULL;
+	}
+
+	shell->seq += 1;
+	char *end = req + sprintf(req, "__succade %s-%lu ", shell->token, shell->seq);
+	end = shell_quote(end, cmd);
+	if (job.input)
+	{
+		*end++ = ' ';
+		end = shell_quote(end, job.input);
+	}
+	*end++ = '\n';
+	*end = '\0';
+
+	int fed = feed_child(shell->child, req);
+	free(req);
+	free(job.input);
+
+	if (fed == -1)
+	{
+		fprintf(stderr, "send_shell(): failed to hand block '%s' to the shell\n", job.block->sid);
+		kita_child_kill(shell->child);
+		job.block->alive = 0;
+		return NULL;
+	}
+
+	shell->block = job.block;
+	shell->sent = now;
+	return job.block;
+}
+
+/*
+ * Checks if `line` is the response to the shell's current request and, if so,
+ * returns a pointer to the output within the line, otherwise NULL. The exit
+ * status of the command is skipped, as it is for blocks run the regular way.
+ */
+static const char *parse_shell(const shell_s *shell, const char *line)
+{
+	char token[BUFFER_SHELL_TOKEN + BUFFER_NUMERIC + 8];
+	int token_len = snprintf(token, sizeof(token), "%s-%lu ", shell->token, shell->seq);
+	if (shell->block == NULL || strncmp(line, token, token_len) != 0)
+	{
+		return NULL;
+	}
+
+	const char *output = line + token_len + strspn(line + token_len, "-0123456789");
+	return *output == ' ' ? output + 1 : output;
+}
+
+/*
+ * Handles the death of the shell process, as reported by kita. The block whose
+ * command was running, if any, keeps its previous output. The shell will be
+ * restarted by check_shell().
+ */
+static void reap_shell(shell_s *shell)
+{
+	if (shell->block)
+	{
+		fprintf(stderr, "reap_shell(): shell died while running block '%s'\n", shell->block->sid);
+		shell->block->alive = 0;
+		shell->block = NULL;
+	}
+	shell->up = 0;
+	backoff_shell(shell);
+}
+
+/*
+ * Kills the shell if its current command has been running for longer than
+ * SHELL_TIMEOUT, restarts the shell if it has died and there are blocks
+ * waiting for it, then hands it the next command, if it isn't busy.
+ */
+static void check_shell(shell_s *shell, double now)
+{
+	if (shell == NULL)
+	{
+		return;
+	}
+
+	if (shell->block && now - shell->sent > SHELL_TIMEOUT)
+	{
+		fprintf(stderr, "check_shell(): block '%s' timed out, restarting shell\n", shell->block->sid);
+		kita_child_kill(shell->child);
+		shell->block->alive = 0;
+		shell->block = NULL;
+		shell->up = 0; // until reaped, see reap_shell()
+	}
+
+	// the old process is gone for good once kita has closed its streams
+	if (!shell->up && shell->len && !kita_child_is_open(shell->child) &&
+			now - shell->spawned >= shell->backoff)
+	{
+		if (spawn_shell(shell, now) == -1)
+		{
+			backoff_shell(shell);
+		}
+	}
+
+	send_shell(shell, now);
+}
+
+/*
+ * Returns the number of seconds until check_shell() has something to do,
+ * or DBL_MAX if there is no shell or nothing to do.
+ */
+static double shell_due_in(const shell_s *shell, double now)
+{
+	if (shell == NULL)
+	{
+		return DBL_MAX;
+	}
+	if (shell->block)
+	{
+		return shell->sent + SHELL_TIMEOUT - now;
+	}
+	if (!shell->up && shell->len)
+	{
+		return shell->spawned + shell->backoff - now;
+	}
+	return DBL_MAX;
+}
+
+/*
+ * Frees the shell's queue and the shell struct itself. The shell's process is
+ * owned by the kita state, which will take care of it.
+ */
+static void free_shell(shell_s *shell)
+{
+	for (; shell->len; --shell->len)
+	{
+		free(shell->jobs[shell->head].input);
+		shell->head = (shell->head + 1) % shell->size;
+	}
+	free(shell->jobs);
+	free(shell);
+}
@@ -0,0 +1,143 @@
+#include <stdio.h>       // fprintf(), fputs()
+#include <stdlib.h>      // EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>      // strlen(), strncmp()
+#include <unistd.h>      // getopt(), close()
+#include <poll.h>        // poll()
+#include <sys/socket.h>  // socket(), bind(), sendto(), recv()
+#include <sys/un.h>      // struct sockaddr_un
+#include "cfg.h"
+#include "succade.h"     // CONTROL_SOCKET_NAME, BUFFER_CONTROL, ...
+#include "helpers.c"     // runtime_path(), ...
+
+#define REPLY_TIMEOUT_MS 1000
+
+/*
+ * succade-msg: sends a single command to a running succade instance via its
+ * control socket and prints the reply. Exits with EXIT_FAILURE if the command
+ * could not be delivered, no reply arrived in time or the reply is an error.
+ */
+
+static void help(const char *invocation, FILE *where)
+{
+	fprintf(where, "USAGE\n");
+	fprintf(where, "\t%s [OPTIONS...] COMMAND [BLOCK [ARG]]\n", invocation);
+	fprintf(where, "\n");
+	fprintf(where, "OPTIONS\n");
+	fprintf(where, "\t-h\tprint this help text and exit\n");
+	fprintf(where, "\t-p\tpath of the control socket\n");
+	fprintf(where, "\t-s\tINI section name of the bar\n");
+	fprintf(where, "\n");
+	fprintf(where, "COMMANDS\n");
+	fprintf(where, "\tstatus\t\t\tlist all blocks with their state and output\n");
+	fprintf(where, "\trefresh [BLOCK]\t\trun the block (or all blocks) now\n");
+	fprintf(where, "\tpause [BLOCK]\t\tdon't run the block (or any block) until resumed\n");
+	fprintf(where, "\tresume [BLOCK]\t\tresume the block (or all blocks)\n");
+	fprintf(where, "\tinterval BLOCK SEC\trun the block every SEC seconds\n");
+	fprintf(where, "\tset BLOCK TEXT\t\tset the block's output to TEXT\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *section = DEFAULT_LEMON_SECTION;
+	const char *path = NULL;
+
+	opterr = 0;
+	int o;
+	while ((o = getopt(argc, argv, "hp:s:")) != -1)
+	{
+		switch (o)
+		{
+			case 'h':
+				help(argv[0], stdout);
+				return EXIT_SUCCESS;
+			case 'p':
+				path = optarg;
+				break;
+			case 's':
+				section = optarg;
+				break;
+		}
+	}
+
+	if (optind >= argc)
+	{
+		help(argv[0], stderr);
+		return EXIT_FAILURE;
+	}
+
+	// join the remaining arguments into the command
+	char cmd[BUFFER_CONTROL] = { 0 };
+	size_t cmd_len = 0;
+	for (int i = optind; i < argc && cmd_len < sizeof(cmd); ++i)
+	{
+		cmd_len += snprintf(cmd + cmd_len, sizeof(cmd) - cmd_len, "%s%s",
+				i > optind ? " " : "", argv[i]);
+	}
+	cmd_len = strlen(cmd);
+
+	// figure out where the control socket lives
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	char *default_path = NULL;
+	if (path == NULL)
+	{
+		char name[BUFFER_BLOCK_NAME + sizeof(CONTROL_SOCKET_NAME)];
+		snprintf(name, sizeof(name), CONTROL_SOCKET_NAME, section);
+		default_path = runtime_path(name);
+		path = default_path;
+	}
+	if (path == NULL)
+	{
+		fprintf(stderr, "No safe runtime directory for the control socket\n");
+		return EXIT_FAILURE;
+	}
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+	int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+	{
+		fprintf(stderr, "Failed to create socket\n");
+		free(default_path);
+		return EXIT_FAILURE;
+	}
+
+	// bind to an autogenerated abstract address, so we can receive the reply
+	struct sockaddr_un self = { .sun_family = AF_UNIX };
+	if (bind(fd, (struct sockaddr *) &self, sizeof(sa_family_t)) == -1)
+	{
+		fprintf(stderr, "Failed to bind socket\n");
+		close(fd);
+		free(default_path);
+		return EXIT_FAILURE;
+	}
+
+	if (sendto(fd, cmd, cmd_len, 0, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+	{
+		fprintf(stderr, "Failed to reach succade via %s\n", path);
+		close(fd);
+		free(default_path);
+		return EXIT_FAILURE;
+	}
+	free(default_path);
+
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	if (poll(&pfd, 1, REPLY_TIMEOUT_MS) <= 0)
+	{
+		fprintf(stderr, "No reply from succade\n");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	char reply[BUFFER_CONTROL];
+	ssize_t len = recv(fd, reply, sizeof(reply) - 1, 0);
+	close(fd);
+	if (len < 0)
+	{
+		fprintf(stderr, "Failed to receive reply\n");
+		return EXIT_FAILURE;
+	}
+	reply[len] = '\0';
+
+	int failed = has_prefix(reply, "error");
+	fputs(reply, failed ? stderr : stdout);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+#ifndef SUCCADE_PLUGIN_H
+#define SUCCADE_PLUGIN_H
+
+//
+// PLUGIN ABI
+//
+// A plugin is a shared object that provides the output for a block without
+// succade having to run a process, used via `command = plugin:/path/foo.so`,
+// optionally followed by arguments. It has to export a `succade_plugin`
+// symbol of type `struct succade_plugin`, with `abi` set to the value of
+// SUCCADE_PLUGIN_ABI it was compiled against. Only `poll` is mandatory.
+//
+// Plugins run on succade's worker threads. For any given block, at most one
+// of its plugin's functions (except `publish`) runs at a time, but different
+// blocks using the same plugin might run concurrently.
+//
+
+#define SUCCADE_PLUGIN_ABI 1
+
+/*
+ * Callback handed to the plugin in `init`. Sets the block's output, which
+ * will be copied. Can be called at any time and from any thread, as long as
+ * the block's `free` hasn't been called yet. `handle` has to be the value
+ * that was passed to `init`.
+ */
+typedef void (*succade_publish_fn)(void *handle, const char *output);
+
+struct succade_plugin
+{
+	unsigned abi;
+
+	/*
+	 * Called once when succade starts, with the arguments given after the
+	 * plugin's path in the block's command (or an empty string). Returns the
+	 * plugin's private context for this block, which will be passed to all
+	 * other functions, or NULL on error. Keep `publish` and `handle` around
+	 * in order to set the block's output.
+	 */
+	void *(*init)(const char *args, succade_publish_fn publish, void *handle);
+
+	/*
+	 * Called whenever the block is due, as per its configuration. `input` is
+	 * the trigger's output if the block consumes it, otherwise NULL. Should
+	 * call `publish` to set the output. Returns the number of seconds after
+	 * which it wants to be called again, or 0 if there is no such need.
+	 */
+	double (*poll)(void *ctx, const char *input);
+
+	/*
+	 * Called when the block has been clicked or scrolled, unless a command
+	 * has been configured for that button. `button` is 1 (left), 2 (middle),
+	 * 3 (right), 4 (scroll up) or 5 (scroll down). Optional.
+	 */
+	void (*click)(void *ctx, int button);
+
+	/*
+	 * Called once when succade exits. Releases the context. Optional.
+	 */
+	void (*free)(void *ctx);
+};
+
+#endif
@@ -5,6 +5,19 @@
 #include <string.h>    // strlen(), strcmp(), ...
 #include <signal.h>    // sigaction(), ... 
 #include <float.h>     // DBL_MAX
+#include <limits.h>    // LONG_MAX
+#include <errno.h>     // errno, ECANCELED
+#include <sys/timerfd.h> // timerfd_create(), timerfd_settime()
+#include <sys/signalfd.h> // signalfd(), struct signalfd_siginfo
+#include <sys/inotify.h> // inotify_init1(), inotify_add_watch(), ...
+#include <sys/socket.h>  // socket(), bind(), setsockopt(), ...
+#include <sys/un.h>      // struct sockaddr_un
+#include <fcntl.h>       // fcntl(), O_NONBLOCK
+#include <sys/mman.h>    // mmap(), munmap()
+#include <sys/eventfd.h> // eventfd()
+#include <net/if.h>      // if_indextoname(), IFF_UP, IFF_RUNNING
+#include <linux/netlink.h>   // NETLINK_KOBJECT_UEVENT, struct sockaddr_nl
+#include <linux/rtnetlink.h> // NETLINK_ROUTE, RTNLGRP_LINK, ...
 #include "ini.h"       // https://github.com/benhoyt/inih
 #include "cfg.h"
 #include "libkita.h"
@@ -12,15 +25,72 @@
 #include "options.c"   // Command line args/options parsing
 #include "helpers.c"   // Helper functions, mostly for strings
 #include "loadini.c"   // Handles loading/processing of INI cfg file
+#include "builtins.c"  // Built-in providers for blocks (builtin:clock, ...)
+#include "plugins.c"   // Loadable plugins for blocks and their worker threads
+#include "scripts.c"   // Lua script blocks, if built with SUCCADE_LUA
+#include "shell.c"     // Persistent shell for shell mode blocks
+#include "filter.c"    // Output filters (field, regex capture, trim, ...)
+#include "format.c"    // Output formatters (thresholds, number formats, ...)
 
 static volatile int running;   // used to stop main loop 
 static volatile int handled;   // last signal that has been handled 
 
+/*
+ * Frees the given run conditions, including the compiled regex, if any.
+ */
+static void free_cond(cond_s *cond)
+{
+	if (cond->block)
+	{
+		regfree(&cond->regex);
+	}
+	if (cond->has_match)
+	{
+		regfree(&cond->match);
+	}
+	if (cond->has_ignore)
+	{
+		regfree(&cond->ignore);
+	}
+	free(cond->payload);
+	free(cond);
+}
+
 /*
  * Frees all members of the given thing that need freeing.
  */
 static void free_thing(thing_s *thing)
 {
+	if (thing->builtin && thing->builtin->free)
+	{
+		thing->builtin->free(thing);
+		thing->data = NULL;
+	}
+
+	if (thing->plugin)
+	{
+		free_plugin(thing->plugin);
+		thing->plugin = NULL;
+	}
+
+	if (thing->cond)
+	{
+		free_cond(thing->cond);
+		thing->cond = NULL;
+	}
+
+	if (thing->filter)
+	{
+		free_filter(thing->filter);
+		thing->filter = NULL;
+	}
+
+	if (thing->fmt)
+	{
+		free_fmt(thing->fmt);
+		thing->fmt = NULL;
+	}
+
 	if (thing->sid)
 	{
 		free(thing->sid);
@@ -31,6 +101,16 @@ static void free_thing(thing_s *thing)
 		free(thing->output);
 	}
 
+	if (thing->input)
+	{
+		free(thing->input);
+	}
+
+	if (thing->partial)
+	{
+		free(thing->partial);
+	}
+
 	cfg_free(&thing->cfg);
 
 	if (thing->child)
@@ -102,18 +182,7 @@ int lemon_arg(thing_s *lemon, char *buf, size_t len)
  */
 static int open_lemon(thing_s *lemon)
 {
-	// Make sure we free the previous argument string, if any
-	free(kita_child_get_arg(lemon->child));
-
-	// Need this on the heap, as kita_child_set_arg just saves a reference
-	char *arg = malloc(BUFFER_LEMON_ARG);
-	if (arg == NULL) return -1;
-
-	// Actually build the lemon's argument string
-	lemon_arg(lemon, arg, BUFFER_LEMON_ARG);
-
-	// Set the argument string, open the process, set stdin to line buffered
-	kita_child_set_arg(lemon->child, arg);
+	// Open the process, set stdin to line buffered
 	if (kita_child_open(lemon->child) == 0)
 	{
 		return kita_child_set_buf_type(lemon->child, KITA_IOS_IN, KITA_BUF_LINE);
@@ -138,8 +207,9 @@ static int open_thing(thing_s *thing)
 
 /*
  * Read from the block's stdout and save the read data, if any, in the block's 
- * output field. Returns 0 if the read data was the same as the previous data
- * already present in the output field, 1 if the newly read data is different.
+ * output field, after applying the block's filters. Returns 0 if the result 
+ * was the same as the previous data already present in the output field, 1 
+ * if the newly read data is different.
  */
 static int read_block(thing_s *block)
 {
@@ -148,6 +218,7 @@ static int read_block(thing_s *block)
 	free(block->output); // just in case, free'ing NULL is fine
 	block->output = kita_child_read(block->child, KITA_IOS_OUT);
 	block->last_read = get_time();
+	filter_output(block, block->output);
 	
 	int same = (old && equals(old, block->output));
 	free(old);
@@ -156,16 +227,139 @@ static int read_block(thing_s *block)
 }
 
 /*
- * Read from the spark's stdout and save the read data, if any, in the spark's
- * output field. Returns 0 if no data (or an empty string) was read, else 1.
+ * Copies the block's output to all blocks that share its child process.
+ * Returns the number of blocks that received the output.
+ */
+static size_t share_output(state_s *state, thing_s *block)
+{
+	size_t shared = 0;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		thing_s *guest = &state->blocks[i];
+		if (guest->host != block)
+		{
+			continue;
+		}
+
+		free(guest->output);
+		guest->output = block->output ? strdup(block->output) : NULL;
+		guest->last_read = block->last_read;
+		++shared;
+	}
+	return shared;
+}
+
+/*
+ * Returns 1 if the block only wants to be run for distinct trigger output and 
+ * has last been run with the given trigger output, otherwise 0.
+ */
+static int block_has_payload(thing_s *block, const char *line)
+{
+	if (!cfg_get_int(&block->cfg, BLOCK_OPT_TRIG_DISTINCT) || block->cond == NULL)
+	{
+		return 0;
+	}
+	return block->cond->payload && equals(block->cond->payload, line);
+}
+
+/*
+ * Checks a line of spark output against the block's trigger filters. 
+ * Returns 1 if the block should be run for this line, otherwise 0.
+ */
+static int block_wants_input(thing_s *block, const char *line)
+{
+	cond_s *cond = block->cond;
+
+	if (cond && cond->has_match && regexec(&cond->match, line, 0, NULL, 0) != 0)
+	{
+		return 0;
+	}
+	if (cond && cond->has_ignore && regexec(&cond->ignore, line, 0, NULL, 0) == 0)
+	{
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Saves the given spark output, which might consist of several lines, in the 
+ * spark's output field (last line only) and hands it to every block subscribed 
+ * to the spark, replacing any input they haven't processed yet, which makes 
+ * them due. Each block picks the latest line that passes its trigger filters.
+ * `lines` will be modified in the process. Returns 0 if `lines` was empty.
+ */
+static int feed_spark(state_s *state, thing_s *spark, char *lines)
+{
+	if (empty(lines))
+	{
+		return 0;
+	}
+
+	// split into lines in place, remembering the last one as output
+	size_t len  = strlen(lines);
+	char  *last = lines;
+	for (size_t c = 0; c < len; ++c)
+	{
+		if (lines[c] == '\n')
+		{
+			lines[c] = '\0';
+			last = (c + 1 < len) ? &lines[c + 1] : last;
+		}
+	}
+
+	free(spark->output);
+	spark->output = strdup(last);
+
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		thing_s *block = &state->blocks[i];
+		if (block->other != spark)
+		{
+			continue;
+		}
+
+		// find the latest line that this block is interested in
+		const char *accepted = NULL;
+		for (const char *line = lines; line < lines + len; line += strlen(line) + 1)
+		{
+			if (!empty(line) && block_wants_input(block, line))
+			{
+				accepted = line;
+			}
+		}
+		if (accepted == NULL)
+		{
+			continue;
+		}
+
+		// back to what the block was last run with, nothing to do
+		free(block->input);
+		block->input = NULL;
+		if (block_has_payload(block, accepted))
+		{
+			continue;
+		}
+
+		block->input = strdup(accepted);
+		block->last_input = spark->last_read;
+	}
+
+	return 1;
+}
+
+/*
+ * Read from the spark's stdout and hand the read data, if any, to all blocks 
+ * subscribed to the spark, see feed_spark(). Returns 0 if no data (or an 
+ * empty string) was read, else 1.
  */
-static int read_spark(thing_s *spark)
+static int read_spark(state_s *state, thing_s *spark)
 {
-	free(spark->output); // just in case, free'ing NULL is fine
-	spark->output = kita_child_read(spark->child, KITA_IOS_OUT);
+	char *lines = kita_child_read_lines(spark->child, KITA_IOS_OUT);
 	spark->last_read = get_time();
 
-	return !empty(spark->output);
+	int fed = feed_spark(state, spark, lines);
+	free(lines);
+	return fed;
 }
 
 /*
@@ -177,7 +371,11 @@ static size_t open_sparks(state_s *state)
 	size_t num_sparks_opened = 0;
 	for (size_t i = 0; i < state->num_sparks; ++i)
 	{
-		num_sparks_opened += (open_thing(&state->sparks[i]) == 0);
+		thing_s *spark = &state->sparks[i];
+		if (spark->child)
+		{
+			num_sparks_opened += (open_thing(spark) == 0);
+		}
 	}
 	return num_sparks_opened;
 }
@@ -208,29 +406,97 @@ static int block_can_consume(thing_s *block)
 {
 	return block->b_type == BLOCK_SPARKED
 		&& cfg_get_int(&block->cfg, BLOCK_OPT_CONSUME) 
-		&& !empty(block->other->output);
+		&& !empty(block->input);
+}
+
+/*
+ * Returns 1 if the block's process has exited, but hasn't been reaped yet.
+ * Persistent blocks keep their process between runs, hence return 0.
+ */
+static int block_is_unreaped(thing_s *block)
+{
+	return !block->alive && block->child && !block->persistent && block->child->pid > 0;
+}
+
+/*
+ * Returns 1 if the block is currently running, otherwise 0. A block whose 
+ * process has exited still counts as running until the process has been 
+ * reaped, as its child can't be opened again before that. Persistent blocks 
+ * are only running while waiting for a response.
+ */
+static int block_is_running(thing_s *block)
+{
+	return block->alive || block_is_unreaped(block);
 }
 
 static double block_due_in(thing_s *block, double now)
 {
-	float reload = cfg_get_float(&block->cfg, BLOCK_OPT_RELOAD);
+	// Blocks sharing another block's child get run by their host,
+	// paused blocks don't get run at all until resumed, running blocks
+	// will wake us up once they're done
+	if (block->host || block->paused || block_is_running(block))
+	{
+		return DBL_MAX;
+	}
+
+	// Built-in and plugin blocks without an interval are due once they say so
+	if ((block->builtin || block->plugin) && block->b_type == BLOCK_ONCE && block->wake > 0.0)
+	{
+		return block->wake - now;
+	}
+
+	// Timed blocks are due once their reload time has elapsed
+	if (block->b_type == BLOCK_TIMED)
+	{
+		float reload = cfg_get_float(&block->cfg, BLOCK_OPT_RELOAD);
+		return reload - (now - block->last_open);
+	}
+
+	// Sparked blocks with pending input are due once their trigger 
+	// has been quiet for the debounce time (zero if not configured)
+	if (block->b_type == BLOCK_SPARKED && block->input)
+	{
+		float debounce = cfg_get_float(&block->cfg, BLOCK_OPT_DEBOUNCE);
+		return debounce - (now - block->last_input);
+	}
 
-	return block->b_type == BLOCK_TIMED ? 
-		reload - (now - block->last_open) : 
-		DBL_MAX;
+	return DBL_MAX;
 }
 
 static int block_is_due(thing_s *block, double now, double tolerance)
 {
 	// block is currently running
-	if (block->alive)
+	if (block_is_running(block))
 	{
 		return 0;
 	}
 
-	// One-shot blocks are due if they have never been run before
+	// Push and sourced blocks are never run, they get fed their output
+	if (block->b_type == BLOCK_PUSH || block->b_type == BLOCK_SOURCED)
+	{
+		return 0;
+	}
+
+	// Paused blocks are never due, not even if marked as such
+	if (block->paused)
+	{
+		return 0;
+	}
+
+	// Blocks that have been explicitly marked as due, for whatever reason
+	if (block->due)
+	{
+		return 1;
+	}
+
+	// One-shot blocks are due if they have never been run before,
+	// built-in and plugin ones also whenever they asked to be run again
 	if (block->b_type == BLOCK_ONCE)
 	{
+		if ((block->builtin || block->plugin) && block->wake > 0.0)
+		{
+			return block_due_in(block, now) <= 0.0;
+		}
 		return block->last_open == 0.0;
 	}
 
@@ -256,10 +522,11 @@ static int block_is_due(thing_s *block, double now, double tolerance)
 			return 0;
 		}
 
-		// spark has output waiting to be processed
-		if (block->other->output)
+		// spark has sent output waiting to be processed; if the spark 
+		// keeps sending more, only the latest input will be processed
+		if (block->input)
 		{
-			return 1;
+			return block_due_in(block, now) <= 0.0;
 		}
 
 		// doesn't consume and has never been run before
@@ -280,597 +547,3202 @@ static int block_is_due(thing_s *block, double now, double tolerance)
 }
 
 /*
- * Opens all blocks that are due and returns the number of blocks opened.
+ * Checks the block's run conditions, if any, without spawning any process. 
+ * For `run-if-changed`, the file's last known state is updated in the process.
+ * Returns 1 if the block may be run, 0 if it should be skipped this time.
  */
-static size_t open_due_blocks(state_s *state, double now)
+static int block_may_run(thing_s *block)
 {
-	size_t opened = 0;
-	thing_s *block = NULL;
-	for (size_t i = 0; i < state->num_blocks; ++i)
+	cond_s *cond = block->cond;
+	if (cond == NULL)
 	{
-		block = &state->blocks[i];
-		if (block_is_due(block, now, BLOCK_WAIT_TOLERANCE))
-		{
-			if (block_can_consume(block))
-			{
-				kita_child_set_arg(block->child, block->other->output);
-				opened += (open_thing(block) == 0);
-				kita_child_set_arg(block->child, NULL);
-			}
-			else
-			{
-				opened += (open_thing(block) == 0);
-			}
-			if (block->b_type == BLOCK_SPARKED)
-			{
-				free(block->other->output);
-				block->other->output = NULL;
-			}
-		}
+		return 1;
 	}
-	return opened;
-}
 
-/*
- * Returns the time, in seconds, until the next block should be run.
- * If no blocks are scheduled for execution, -1 will be returned.
- */
-static double time_to_wait(state_s *state, double now)
-{
-	double lemon_due = DBL_MAX;
-	double thing_due = DBL_MAX;
+	struct stat st;
 
-	for (size_t i = 0; i < state->num_blocks; ++i)
+	const char *exists = cfg_get_str(&block->cfg, BLOCK_OPT_IF_EXISTS);
+	if (exists && stat(exists, &st) == -1)
+	{
+		return 0;
+	}
+
+	const char *missing = cfg_get_str(&block->cfg, BLOCK_OPT_IF_MISSING);
+	if (missing && stat(missing, &st) == 0)
 	{
-		thing_due = block_due_in(&state->blocks[i], now);
+		return 0;
+	}
 
-		if (thing_due < lemon_due)
+	if (cond->block)
+	{
+		const char *output = cond->block->output;
+		int match = output && regexec(&cond->regex, output, 0, NULL, 0) == 0;
+		if (match == cond->negate)
 		{
-			lemon_due = thing_due;
+			return 0;
 		}
 	}
 
-	return (lemon_due == DBL_MAX) ? -1 : lemon_due;
+	if (cond->changed)
+	{
+		// a missing file is treated like an empty one that never changes
+		st = (struct stat) { 0 };
+		stat(cond->changed, &st);
+
+		int same = cond->seen
+			&& st.st_ino  == cond->last.st_ino
+			&& st.st_size == cond->last.st_size
+			&& st.st_mtim.tv_sec  == cond->last.st_mtim.tv_sec
+			&& st.st_mtim.tv_nsec == cond->last.st_mtim.tv_nsec;
+
+		cond->last = st;
+		cond->seen = 1;
+		if (same)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
 }
 
 /*
- * Given a block, returns a malloc'd string that contains both the block's
- * output, as well as its unit string (if any). The length (excluding the 
- * null terminator) of the resulting string will be returned in `len` and 
- * the additional characters, that have been added due to escaping of the 
- * result and unit string, will be returned in `diff`, if given.
+ * Skips a run of the given block that was due, but whose run conditions did not
+ * hold. The block keeps its previous output, but its schedule moves on, as if 
+ * it had been run. One-shot blocks stay due, so they will be checked again.
  */
-char* resultstr(const thing_s *block, int *len, size_t *diff)
+static void skip_block(thing_s *block, double now)
 {
-	// The 'diff' will tell us how many extra characters the string gained
-	// because of escaping '%' signs; we need this amount for the min_width 
-	// value, because while those additional characters have to be taken 
-	// into account for snprintf(), they aren't part of the visible output
-
-	const cfg_s *bcfg = &block->cfg;
-	
-	size_t rdiff = 0;
-	char *result = cfg_get_int(bcfg, BLOCK_OPT_RAW) ? 
-		strdup(block->output) : escape(block->output, '%', &rdiff);
+	if (block->b_type != BLOCK_ONCE)
+	{
+		block->last_open = now;
+	}
+}
 
-	size_t udiff = 0;
-	char *unit = escape(strsel(cfg_get_str(bcfg, BLOCK_OPT_UNIT), "", ""), '%', &udiff);
+/*
+ * Creates the status page at the given path, with one entry per block, and 
+ * maps it into memory. Must only be called once all blocks have been loaded.
+ * Returns 0 on success, -1 on error.
+ */
+static int open_status(state_s *state, const char *path)
+{
+	size_t size = sizeof(status_page_s) + state->num_blocks * sizeof(status_entry_s);
 
-	if (diff)
+	// only ever create a new file, and never follow a symlink to another
+	unlink(path);
+	int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd == -1)
 	{
-		*diff = rdiff + udiff;
+		return -1;
 	}
 
-	size_t output_len = strlen(result) + strlen(unit) + 1;
-	char *output = malloc(sizeof(char) * output_len);
+	if (ftruncate(fd, size) == -1)
+	{
+		close(fd);
+		unlink(path);
+		return -1;
+	}
 
-	*len = snprintf(output, output_len, "%s%s", result, unit);
+	status_page_s *page = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED)
+	{
+		unlink(path);
+		return -1;
+	}
 
-	free(result);
-	free(unit);
+	page->magic       = STATUS_PAGE_MAGIC;
+	page->version     = STATUS_PAGE_VERSION;
+	page->num_entries = state->num_blocks;
+	page->entry_size  = sizeof(status_entry_s);
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		page->entries[i].type = state->blocks[i].b_type;
+		snprintf(page->entries[i].name, BUFFER_BLOCK_NAME, "%s", state->blocks[i].sid);
+	}
 
-	return output;
+	state->status      = page;
+	state->status_size = size;
+	state->status_path = strdup(path);
+	return 0;
 }
 
 /*
- * Given a block, writes a string to the given buf that is the formatted result 
- * of this block's script output, ready to be fed to Lemonbar, including prefix,
- * label and suffix. Returns the number of characters written to buf.
+ * Unmaps the status page, if any, and removes it from the file system.
  */
-int blockstr(const thing_s *lemon, const thing_s *block, char *buf, size_t len)
+static void close_status(state_s *state)
 {
-	// for convenience
-	const cfg_s *bcfg = &block->cfg;
-	const cfg_s *lcfg = &lemon->cfg;
-
-	char action_start[(5 * strlen(block->sid)) + 64];
-	char action_end[24];  
-	action_start[0] = 0;
-	action_end[0]   = 0;
-
-	if (cfg_has(bcfg, BLOCK_OPT_CMD_LMB))
+	if (state->status)
 	{
-		strcat(action_start, "%{A1:");
-		strcat(action_start, block->sid);
-		strcat(action_start, "_lmb:}");
-		strcat(action_end, "%{A}");
+		munmap(state->status, state->status_size);
+		state->status = NULL;
 	}
-	if (cfg_has(bcfg, BLOCK_OPT_CMD_MMB))
+	if (state->status_path)
 	{
-		strcat(action_start, "%{A2:");
-		strcat(action_start, block->sid);
-		strcat(action_start, "_mmb:}");
-		strcat(action_end, "%{A}");
+		unlink(state->status_path);
+		free(state->status_path);
+		state->status_path = NULL;
 	}
-	if (cfg_has(bcfg, BLOCK_OPT_CMD_RMB))
+}
+
+/*
+ * Returns the given block's entry on the status page, with its seqlock held, 
+ * or NULL if there is no status page. Call status_unlock() when done.
+ */
+static status_entry_s *status_lock(state_s *state, const thing_s *block)
+{
+	if (state->status == NULL)
 	{
-		strcat(action_start, "%{A3:");
-		strcat(action_start, block->sid);
-		strcat(action_start, "_rmb:}");
-		strcat(action_end, "%{A}");
+		return NULL;
 	}
-	if (cfg_has(bcfg, BLOCK_OPT_CMD_SUP))
+
+	status_entry_s *entry = &state->status->entries[block - state->blocks];
+	atomic_fetch_add_explicit(&entry->seq, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	return entry;
+}
+
+/*
+ * Releases the seqlock of the given status page entry.
+ */
+static void status_unlock(status_entry_s *entry)
+{
+	atomic_fetch_add_explicit(&entry->seq, 1, memory_order_release);
+}
+
+/*
+ * Writes the given block's current output to its entry on the status page.
+ */
+static void update_status(state_s *state, const thing_s *block)
+{
+	status_entry_s *entry = status_lock(state, block);
+	if (entry)
 	{
-		strcat(action_start, "%{A4:");
-		strcat(action_start, block->sid);
-		strcat(action_start, "_sup:}");
-		strcat(action_end, "%{A}");
+		snprintf(entry->output, BUFFER_BLOCK_RESULT, "%s", strsel(block->output, "", ""));
+		entry->updated = get_time();
+		++entry->changes;
+		status_unlock(entry);
 	}
-	if (cfg_has(bcfg, BLOCK_OPT_CMD_SDN))
+}
+
+/*
+ * Counts a run of the given block, as well as of all blocks sharing its 
+ * process, on the status page.
+ */
+static void count_run(state_s *state, const thing_s *block)
+{
+	for (size_t i = 0; state->status && i < state->num_blocks; ++i)
 	{
-		strcat(action_start, "%{A5:");
-		strcat(action_start, block->sid);
-		strcat(action_start, "_sdn:}");
-		strcat(action_end, "%{A}");
+		thing_s *other = &state->blocks[i];
+		if (other == block || other->host == block)
+		{
+			status_entry_s *entry = status_lock(state, other);
+			++entry->runs;
+			status_unlock(entry);
+		}
 	}
+}
 
-	// TODO we're missing the UNIT option, add that! let's have the
-	//      unit have the same foreground and background color as 
-	//      the actual block result string, that should be okay.
-	//      but, be careful! the length of the unit string, plus the 
-	//      separating space, need to be taken into account when 
-	//      calculating the padding (fixed width) of the block, no?
+/*
+ * Creates a kita watch for the file descriptor `fd` and adds it to the kita 
+ * state, with the succade state as context. On error, `fd` will be closed. 
+ * Returns the watch or NULL on error.
+ */
+static kita_watch_s *make_watch(state_s *state, int fd)
+{
+	kita_watch_s *watch = kita_watch_new(fd);
+	if (watch == NULL)
+	{
+		close(fd);
+		return NULL;
+	}
 
-	const char *block_fg = strsel(cfg_get_str(bcfg, BLOCK_OPT_FG),       "-", "");
-	const char *block_bg = strsel(cfg_get_str(bcfg, BLOCK_OPT_BG),       "-", "");
-	const char *label_fg = strsel(cfg_get_str(bcfg, BLOCK_OPT_LABEL_FG), "-", "");
-	const char *label_bg = strsel(cfg_get_str(bcfg, BLOCK_OPT_LABEL_BG), "-", "");
-	const char *affix_fg = strsel(cfg_get_str(bcfg, BLOCK_OPT_AFFIX_FG), "-", "");
-	const char *affix_bg = strsel(cfg_get_str(bcfg, BLOCK_OPT_AFFIX_BG), "-", "");
-	const char *lc       = strsel(cfg_get_str(bcfg, BLOCK_OPT_LC),       "-", "");
+	if (kita_watch_add(state->kita, watch) == -1)
+	{
+		kita_watch_free(&watch);
+		close(fd);
+		return NULL;
+	}
 
-	int font_count = 0;
+	kita_watch_set_context(watch, state);
+	return watch;
+}
 
-	char block_font_idx = cfg_get_str(lcfg, LEMON_OPT_BLOCK_FONT) ? (++font_count) + '0' : '-'; // 1st slot
-	char label_font_idx = cfg_get_str(lcfg, LEMON_OPT_LABEL_FONT) ? (++font_count) + '0' : '-'; // 2nd slot
-	char affix_font_idx = cfg_get_str(lcfg, LEMON_OPT_AFFIX_FONT) ? (++font_count) + '0' : '-'; // 3rd slot
+/*
+ * Removes the watch from the kita state, closes its file descriptor and frees 
+ * it, setting it to NULL. Does nothing if the watch is NULL already.
+ */
+static void free_watch(kita_watch_s **watch)
+{
+	if (*watch == NULL)
+	{
+		return;
+	}
 
-	const char *prefix   = strsel(cfg_get_str(bcfg, BLOCK_OPT_PREFIX), "", "");
-	const char *suffix   = strsel(cfg_get_str(bcfg, BLOCK_OPT_SUFFIX), "", "");
-	const char *label    = strsel(cfg_get_str(bcfg, BLOCK_OPT_LABEL),  "", "");
+	int fd = (*watch)->fd;
+	kita_watch_free(watch);
+	close(fd);
+}
 
-	int padding_l = cfg_get_int(bcfg, BLOCK_OPT_PADDING_LEFT);
-	int padding_r = cfg_get_int(bcfg, BLOCK_OPT_PADDING_RIGHT);
-	int margin_l  = cfg_get_int(bcfg, BLOCK_OPT_MARGIN_LEFT);
-	int margin_r  = cfg_get_int(bcfg, BLOCK_OPT_MARGIN_RIGHT);
-	int ol        = cfg_get_int(bcfg, BLOCK_OPT_OL);
-	int ul        = cfg_get_int(bcfg, BLOCK_OPT_UL);
+/*
+ * Opens the events socket, a unix stream socket at the given path, to which 
+ * other programs can connect in order to receive a line, `BLOCK OUTPUT`, for 
+ * every change in any block's output. A stale socket at that path will be 
+ * replaced. Returns 0 on success, -1 on error.
+ */
+static int open_events(state_s *state, const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
 
-	int     rlen      = 0;
-	size_t  rdiff     = 0;
-	char   *result    = resultstr(block, &rlen, &rdiff);
-	int     min_width = cfg_get_int(bcfg, BLOCK_OPT_MIN_WIDTH) + rdiff;
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+	{
+		return -1;
+	}
 
-	// TODO currently we are adding the format thingies for label, 
-	//      prefix and suffix, even if those are empty anyway, which
-	//      makes the string much longer than it needs to be, hence 
-	//      also increasing the parsing workload for lemonbar.
-	//      but of course, replacing a couple bytes with lots of malloc
-	//      would not be great either, so... not sure about it yet.
+	unlink(path);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1)
+	{
+		close(fd);
+		return -1;
+	}
 
-	// TODO bug! bug! bug! we just used font slots 1 to 3 here, but maybe
-	//      we're only loading one or two (or zero) fonts! NO BUENO!
+	state->events = make_watch(state, fd);
+	if (state->events == NULL)
+	{
+		unlink(path);
+		return -1;
+	}
 
-	int res = snprintf(buf, len,
-		"%%{O%d}"                                      // margin left
-		"%s"                                           // action start
-		"%%{F%s B%s U%s %co %cu}"                      // format start
-		"%%{T%c F%s B%s}%s"                            // prefix
-		"%%{T%c F%s B%s}%s"                            // label
-		"%%{T%c F%s B%s}%*s%*s%*s"                     // block
-		"%%{T%c F%s B%s}%s"                            // suffix
-		"%%{T- F- B- U- -o -u}"                        // format end
-		"%s"                                           // action end
-		"%%{O%d}",                                     // margin right
-		// margin left
-		margin_l,
-		// action start
-		action_start,
-		// format start       
-		block_fg, block_bg, lc, (ol ? '+' : '-'), (ul ? '+' : '-'),
-		// prefix
-		affix_font_idx, affix_fg, affix_bg, prefix,
-		// label
-		label_font_idx, label_fg, label_bg, label,
-		// block
-		block_font_idx, block_fg, block_bg, padding_l, "", min_width, result, padding_r, "",
-		// suffix
-		affix_font_idx, affix_fg, affix_bg, suffix,
-		// action end
-		action_end,
-		// margin right
-		margin_r
-	);
+	state->events_path = strdup(path);
+	return 0;
+}
 
-	free(result);
-	return res;
+/*
+ * Disconnects the subscriber at index `idx` and removes it from the state. 
+ * Note that this moves the last subscriber to index `idx`.
+ */
+static void drop_sub(state_s *state, size_t idx)
+{
+	sub_s *sub = &state->subs[idx];
+	free_watch(&sub->watch);
+	free(sub->queue);
+
+	state->subs[idx] = state->subs[--state->num_subs];
 }
 
 /*
- * Returns 'l', 'c' or 'r' for input values -1, 0 and 1 respectively.
- * For other input values, the behavior is undefined.
+ * Disconnects all subscribers, closes the events socket, if open, and removes 
+ * it from the file system.
  */
-static char get_align(const int align)
+static void close_events(state_s *state)
 {
-	char a[] = {'l', 'c', 'r'};
-	return a[align+1]; 
+	while (state->num_subs)
+	{
+		drop_sub(state, 0);
+	}
+	free(state->subs);
+	state->subs = NULL;
+
+	free_watch(&state->events);
+	if (state->events_path)
+	{
+		unlink(state->events_path);
+		free(state->events_path);
+		state->events_path = NULL;
+	}
 }
 
 /*
- * Combines the results of all given blocks into a single string that can be fed
- * to Lemonbar. Returns a pointer to the string, allocated with malloc().
+ * Sends as much of the subscriber's queue as the connection will take without 
+ * blocking and asks kita to tell us when it will take more, if needed. 
+ * Returns 0 on success, -1 if the subscriber should be dropped.
  */
-static char *barstr(const state_s *state)
+static int flush_sub(sub_s *sub)
 {
-	// This should never happen, but just in case (also makes compiler happy)
-	if (state->num_blocks == 0)
+	while (sub->len)
 	{
-		return NULL;
+		ssize_t n = send(sub->watch->fd, sub->queue, sub->len, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (n == -1)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				break;
+			}
+			return -1;
+		}
+
+		// if we stopped mid-line, the rest of it must not be dropped later
+		char *nl = (sub->queue[n - 1] == '\n') ? NULL : 
+			memchr(sub->queue + n, '\n', sub->len - n);
+		sub->keep = nl ? (size_t) (nl - (sub->queue + n)) + 1 : 0;
+
+		memmove(sub->queue, sub->queue + n, sub->len - n);
+		sub->len -= n;
 	}
-	
-	// For convenience
-	size_t num_blocks = state->num_blocks;
 
-	// String to place in between any two blocks
-	char *sep = cfg_get_str(&state->lemon.cfg, LEMON_OPT_SEPARATOR);
-	size_t sep_len = sep ? strlen(sep) : 0;
+	int feed = (sub->len > 0);
+	if (feed != sub->feed && kita_watch_set_feed(sub->watch, feed) == 0)
+	{
+		sub->feed = feed;
+	}
+	return 0;
+}
 
-	// Short blocks like temperature, volume or battery, will usually use 
-	// something in the range of 130 to 200 byte. So let's go with 256 byte.
-	size_t bar_str_len = BUFFER_BLOCK_RESULT * num_blocks;
-	char *bar_str = malloc(bar_str_len);
-	bar_str[0] = '\0';
+/*
+ * Appends the line, which has to end in a newline, to the subscriber's queue. 
+ * If the queue is full, the oldest lines will be dropped to make room. 
+ */
+static void queue_sub(sub_s *sub, const char *line, size_t len)
+{
+	if (len > BUFFER_SUBSCRIBER - sub->keep)
+	{
+		++sub->dropped;
+		return;
+	}
 
-	char align[5];
-	int last_align = -1;
+	while (sub->len + len > BUFFER_SUBSCRIBER)
+	{
+		char  *head = sub->queue + sub->keep;
+		char  *nl   = memchr(head, '\n', sub->len - sub->keep);
+		size_t drop = (nl - head) + 1;
 
-	char block_str[BUFFER_BLOCK_STR];
-	const thing_s *block = NULL;
-	for (size_t i = 0; i < num_blocks; ++i)
+		memmove(head, head + drop, sub->len - sub->keep - drop);
+		sub->len -= drop;
+		++sub->dropped;
+	}
+
+	memcpy(sub->queue + sub->len, line, len);
+	sub->len += len;
+}
+
+/*
+ * Queues the given block's current output for the subscriber.
+ */
+static void queue_block(sub_s *sub, const thing_s *block)
+{
+	char line[BUFFER_BLOCK_STR];
+	int len = snprintf(line, sizeof(line), "%s %s\n", block->sid, strsel(block->output, "", ""));
+	if (len >= (int) sizeof(line))
 	{
-		block = &state->blocks[i];
+		// output was truncated, make sure the line still ends properly
+		len = sizeof(line) - 1;
+		line[len - 1] = '\n';
+	}
+	queue_sub(sub, line, len);
+}
 
-		// Live blocks might not have a result available
-		if (block->output == NULL)
+/*
+ * Hands the given block's output to all sparks of the form `block:name` that 
+ * watch this block, which in turn will make their blocks due. 
+ * Returns the number of sparks fired.
+ */
+static size_t fire_block_sparks(state_s *state, const thing_s *block)
+{
+	size_t fired = 0;
+	for (size_t i = 0; i < state->num_sparks; ++i)
+	{
+		thing_s *spark = &state->sparks[i];
+		if (spark->s_type != SPARK_BLOCK || spark->other != block)
 		{
 			continue;
 		}
 
-		// Figure out the alignment of this block
-		int block_align = cfg_get_int(&block->cfg, BLOCK_OPT_ALIGN);
-		int same_align = block_align == last_align;
-
-		// Build the block string
-		int block_str_len = blockstr(&state->lemon, block, block_str, BUFFER_BLOCK_STR);
+		char *output = strdup(strsel(block->output, "", ""));
+		spark->last_read = get_time();
+		fired += feed_spark(state, spark, output);
+		free(output);
+	}
+	return fired;
+}
 
-		// Potentially change the alignment
-		if (!same_align)
+/*
+ * Sends the current output of the given block to all subscribers. Subscribers 
+ * that have gone away will be dropped. Returns the number of remaining ones.
+ */
+static size_t publish_block(state_s *state, const thing_s *block)
+{
+	for (size_t i = 0; i < state->num_subs; ++i)
+	{
+		sub_s *sub = &state->subs[i];
+		queue_block(sub, block);
+		if (flush_sub(sub) == -1)
 		{
-			last_align = block_align;
-			snprintf(align, 5, "%%{%c}", get_align(last_align));
-			strcat(bar_str, align);
+			drop_sub(state, i--);
 		}
-		
-		// Let's check if this block string can fit in our buffer
-		size_t free_len = bar_str_len - (strlen(bar_str) + sep_len + 1);
-		if (block_str_len > free_len)
+	}
+	return state->num_subs;
+}
+
+/*
+ * To be called whenever the given block's output has changed: formats the 
+ * output, updates the status page and notifies subscribers, for the block 
+ * itself as well as for all blocks that share its process (call 
+ * share_output() first).
+ */
+static void output_changed(state_s *state, const thing_s *block)
+{
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		thing_s *other = &state->blocks[i];
+		if (other == block || other->host == block)
 		{
-			// Let's make space for approx. two more blocks
-			bar_str_len += BUFFER_BLOCK_RESULT * 2; 
-			bar_str = realloc(bar_str, bar_str_len);
+			apply_fmt(other);
+			update_status(state, other);
+			publish_block(state, other);
+			fire_block_sparks(state, other);
+		}
+	}
+}
+
+/*
+ * Runs the given built-in block, which happens right away, within succade's
+ * own process. Consumable trigger output, if any, will be handed to the 
+ * provider. Returns 1 if the block's output has changed, otherwise 0.
+ */
+static int run_builtin(state_s *state, thing_s *block, double now)
+{
+	char buf[BUFFER_BLOCK_RESULT] = { 0 };
+	const char *input = block_can_consume(block) ? block->input : NULL;
+
+	double next = block->builtin->run(block, input, buf, sizeof(buf));
+	filter_output(block, buf);
+	block->last_open = now;
+	block->last_read = now;
+	block->wake = (next > 0.0) ? now + next : 0.0;
+
+	if (block->output && equals(block->output, buf))
+	{
+		return 0;
+	}
+
+	free(block->output);
+	block->output = strdup(buf);
+	share_output(state, block);
+	output_changed(state, block);
+	state->due = 1;
+	return 1;
+}
+
+/*
+ * Hands the given plugin block to the worker threads, which will call the 
+ * plugin's poll() function. The block counts as running until it returns,
+ * see read_plugins(). Returns 0 on success, -1 on error.
+ */
+static int run_plugin(thing_s *block, double now)
+{
+	const char *input = block_can_consume(block) ? block->input : NULL;
+
+	if (queue_plugin(block->plugin, input, 0) == -1)
+	{
+		// timed blocks are retried on their next interval, but one-shot 
+		// ones would never be due again, so retry those shortly
+		if (block->b_type == BLOCK_ONCE)
+		{
+			block->wake = now + BLOCK_WAIT_TOLERANCE;
+		}
+		else
+		{
+			block->last_open = now;
+		}
+		return -1;
+	}
+	block->last_open = now;
+	block->wake = 0.0;
+	block->alive = 1;
+	return 0;
+}
+
+/*
+ * Queues the given shell mode block to have its command run by the persistent
+ * shell, which happens right away if the shell isn't busy. The block counts 
+ * as running until the shell responds, see read_shell(). 
+ * Returns 0 on success, -1 on error.
+ */
+static int run_shell(state_s *state, thing_s *block, double now)
+{
+	const char *input = block_can_consume(block) ? block->input : NULL;
+
+	block->last_open = now;
+	if (state->shell == NULL || queue_shell(state->shell, block, input) == -1)
+	{
+		return -1;
+	}
+	block->alive = 1;
+	send_shell(state->shell, now);
+	return 0;
+}
+
+/*
+ * Doubles the time to wait before restarting the given persistent block's 
+ * process, starting at PERSISTENT_BACKOFF_MIN and capped at PERSISTENT_BACKOFF_MAX,
+ * and sets the block's wake time accordingly.
+ */
+static void backoff_persistent(thing_s *block, double now)
+{
+	block->backoff *= 2.0;
+	if (block->backoff < PERSISTENT_BACKOFF_MIN)
+	{
+		block->backoff = PERSISTENT_BACKOFF_MIN;
+	}
+	if (block->backoff > PERSISTENT_BACKOFF_MAX)
+	{
+		block->backoff = PERSISTENT_BACKOFF_MAX;
+	}
+	block->wake = now + block->backoff;
+}
+
+/*
+ * Sends a request to the given persistent block's process, which is started 
+ * first, unless it is still running from a previous run. The request is the 
+ * consumable trigger output, if any, or an empty line. The block counts as 
+ * running until the process responds with a line of output. If the process 
+ * died less than its backoff time ago, or was killed and hasn't been reaped 
+ * yet, this run is skipped. Returns 0 on success, -1 on error.
+ */
+static int run_persistent(thing_s *block, double now)
+{
+	const char *input = block_can_consume(block) ? block->input : "";
+
+	block->last_open = now;
+	if (now < block->wake)
+	{
+		return -1;
+	}
+	if (!kita_child_is_alive(block->child))
+	{
+		if (kita_child_open(block->child) == -1)
+		{
+			backoff_persistent(block, now);
+			return -1;
+		}
+		kita_child_set_buf_type(block->child, KITA_IOS_IN, KITA_BUF_LINE);
+	}
+
+	// the request is the input, if any, and a newline, fed separately
+	if ((!empty(input) && feed_child(block->child, input) == -1) ||
+			feed_child(block->child, "\n") == -1)
+	{
+		return -1;
+	}
+	block->alive = 1;
+	return 0;
+}
+
+/*
+ * Kills the processes of all persistent blocks that haven't responded to their
+ * last request within PERSISTENT_TIMEOUT seconds. They will be restarted like 
+ * any other persistent block whose process died, see on_child_reaped().
+ * Returns the number of processes killed.
+ */
+static size_t check_persistent(state_s *state, double now)
+{
+	size_t killed = 0;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		thing_s *block = &state->blocks[i];
+		if (!block->persistent || !block->alive || now - block->last_open <= PERSISTENT_TIMEOUT)
+		{
+			continue;
+		}
+
+		fprintf(stderr, "check_persistent(): block '%s' timed out, restarting it\n", block->sid);
+		kita_child_kill(block->child);
+		block->alive = 0;
+		block->wake  = DBL_MAX; // until reaped, see on_child_reaped()
+		++killed;
+	}
+	return killed;
+}
+
+/*
+ * Opens all blocks that are due and returns the number of blocks opened.
+ */
+static size_t open_due_blocks(state_s *state, double now)
+{
+	size_t opened = 0;
+	thing_s *block = NULL;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+
+		// Blocks sharing another block's child get run by their host
+		if (block->host)
+		{
+			continue;
+		}
+
+		if (block_is_due(block, now, BLOCK_WAIT_TOLERANCE))
+		{
+			int skipped = !block_may_run(block);
+			if (skipped)
+			{
+				skip_block(block, now);
+			}
+			else if (block->builtin)
+			{
+				run_builtin(state, block, now);
+				count_run(state, block);
+				++opened;
+			}
+			else if (block->plugin)
+			{
+				opened += (run_plugin(block, now) == 0);
+			}
+			else if (block->in_shell)
+			{
+				opened += (run_shell(state, block, now) == 0);
+			}
+			else if (block->persistent)
+			{
+				opened += (run_persistent(block, now) == 0);
+			}
+			else if (block_can_consume(block))
+			{
+				kita_child_set_arg(block->child, block->input);
+				opened += (open_thing(block) == 0);
+				kita_child_set_arg(block->child, NULL);
+			}
+			else
+			{
+				opened += (open_thing(block) == 0);
+			}
+			if (block->alive)
+			{
+				count_run(state, block);
+			}
+			if (block->b_type == BLOCK_SPARKED && block->cond && !skipped)
+			{
+				// remember the input of actual runs for trigger-distinct
+				free(block->cond->payload);
+				block->cond->payload = block->input;
+				block->input = NULL;
+			}
+			if (block->b_type == BLOCK_SPARKED)
+			{
+				free(block->input);
+				block->input = NULL;
+			}
+			block->due = 0;
+		}
+	}
+	return opened;
+}
+
+/*
+ * Looks for the field `name` in the given line of multiplexed output, where 
+ * fields are separated by tabs and have the format `name=value`. Fields without
+ * a name can be referred to by their position, starting at 1. Only the first 
+ * `line_len` chars of `line` are looked at, so it doesn't need to be terminated.
+ * Returns a pointer to the field's value and sets `len` to its length, or NULL.
+ */
+static const char *find_field(const char *line, size_t line_len, const char *name, size_t *len)
+{
+	size_t name_len = strlen(name);
+	size_t pos = 1;
+	char num[BUFFER_NUMERIC];
+	const char *end = line + line_len;
+
+	for (const char *field = line; field < end; ++pos)
+	{
+		const char *tab = memchr(field, '\t', end - field);
+		size_t field_len = tab ? (size_t) (tab - field) : (size_t) (end - field);
+		const char *eq = memchr(field, '=', field_len);
+
+		if (eq && (size_t) (eq - field) == name_len && strncmp(field, name, name_len) == 0)
+		{
+			*len = field_len - name_len - 1;
+			return eq + 1;
+		}
+
+		snprintf(num, sizeof(num), "%zu", pos);
+		if (eq == NULL && equals(num, name))
+		{
+			*len = field_len;
+			return field;
+		}
+
+		field += field_len + (tab != NULL);
+	}
+	return NULL;
+}
+
+/*
+ * Reads all lines the multiplexed block has printed and routes the fields 
+ * therein to the blocks using it as their source, after applying their filters.
+ * Only blocks whose filtered field has actually changed will be updated. Returns the number of those blocks.
+ */
+static size_t demux_block(state_s *state, thing_s *source)
+{
+	char *lines = kita_child_read_lines(source->child, KITA_IOS_OUT);
+	if (lines == NULL)
+	{
+		return 0;
+	}
+
+	source->last_read = get_time();
+	size_t changed = 0;
+
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		thing_s *block = &state->blocks[i];
+		if (block->other == NULL || (block->other != source && block->other->host != source))
+		{
+			continue;
+		}
+		if (block->b_type != BLOCK_SOURCED)
+		{
+			continue;
+		}
+
+		// the last line that has the block's field wins
+		const char *field = strsel(cfg_get_str(&block->cfg, BLOCK_OPT_FIELD), block->sid, block->sid);
+		const char *value = NULL;
+		size_t value_len = 0;
+		const char *line = lines;
+		while (*line)
+		{
+			size_t line_len = strcspn(line, "\n");
+
+			size_t len;
+			const char *found = find_field(line, line_len, field, &len);
+			if (found)
+			{
+				value = found;
+				value_len = len;
+			}
+			line += line_len + (line[line_len] == '\n');
+		}
+
+		if (value == NULL)
+		{
+			continue;
+		}
+
+		char *output = strndup(value, value_len);
+		filter_output(block, output);
+		if (output == NULL || (block->output && equals(block->output, output)))
+		{
+			free(output);
+			continue;
+		}
+
+		free(block->output);
+		block->output = output;
+		block->last_read = source->last_read;
+		output_changed(state, block);
+		state->due = 1;
+		++changed;
+	}
+
+	free(source->output);
+	source->output = lines;
+	return changed;
+}
+
+/*
+ * Accepts all pending connections on the events socket as new subscribers.
+ * Returns the number of subscribers added.
+ */
+static size_t accept_subs(state_s *state)
+{
+	size_t num_added = 0;
+	int fd;
+	while ((fd = accept(state->events->fd, NULL, NULL)) != -1)
+	{
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+		sub_s *subs = realloc(state->subs, (state->num_subs + 1) * sizeof(sub_s));
+		char *queue = malloc(BUFFER_SUBSCRIBER);
+		if (subs == NULL || queue == NULL)
+		{
+			state->subs = subs ? subs : state->subs;
+			free(queue);
+			close(fd);
+			break;
+		}
+		state->subs = subs;
+
+		kita_watch_s *watch = make_watch(state, fd);
+		if (watch == NULL)
+		{
+			free(queue);
+			continue;
+		}
+
+		state->subs[state->num_subs++] = (sub_s) { .watch = watch, .queue = queue };
+		++num_added;
+	}
+	return num_added;
+}
+
+/*
+ * Adds the data `buf` of length `len` received from the subscriber `sub` to 
+ * its line buffer, ignoring carriage returns. Lines that are too long for the 
+ * buffer are discarded. 
+ * Returns 1 if a complete line `snapshot` was received, otherwise 0.
+ */
+static int scan_sub(sub_s *sub, const char *buf, size_t len)
+{
+	int snapshot = 0;
+	for (size_t i = 0; i < len; ++i)
+	{
+		if (buf[i] == '\n')
+		{
+			if (sub->line_len < sizeof(sub->line))
+			{
+				sub->line[sub->line_len] = '\0';
+				snapshot = snapshot || equals(sub->line, "snapshot");
+			}
+			sub->line_len = 0;
+		}
+		else if (buf[i] == '\r')
+		{
+			continue;
+		}
+		else if (sub->line_len < sizeof(sub->line) - 1)
+		{
+			sub->line[sub->line_len++] = buf[i];
+		}
+		else
+		{
+			sub->line_len = sizeof(sub->line);
+		}
+	}
+	return snapshot;
+}
+
+/*
+ * Handles data sent by the subscriber at index `idx`. Subscribers may send 
+ * `snapshot`, on a line of its own, to receive the current output of all 
+ * blocks. If the subscriber has disconnected, it will be dropped. 
+ * Returns 0 on success, -1 if dropped.
+ */
+static int read_sub(state_s *state, size_t idx)
+{
+	sub_s *sub = &state->subs[idx];
+	char buf[BUFFER_BLOCK_NAME];
+	ssize_t len;
+	int snapshot = 0;
+
+	while ((len = recv(sub->watch->fd, buf, sizeof(buf), 0)) > 0)
+	{
+		snapshot = scan_sub(sub, buf, len) || snapshot;
+	}
+
+	if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+	{
+		drop_sub(state, idx);
+		return -1;
+	}
+
+	if (snapshot)
+	{
+		for (size_t b = 0; b < state->num_blocks; ++b)
+		{
+			queue_block(sub, &state->blocks[b]);
+		}
+	}
+
+	if (flush_sub(sub) == -1)
+	{
+		drop_sub(state, idx);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Marks all timed blocks as due, so that they will be run on the next iteration
+ * of the main loop, regardless of their interval. Used after the system has 
+ * been suspended or the clock jumped, as their output is likely to be stale.
+ * Returns the number of blocks marked as due.
+ */
+static size_t refresh_timed_blocks(state_s *state)
+{
+	size_t marked = 0;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		if (state->blocks[i].b_type == BLOCK_TIMED)
+		{
+			state->blocks[i].due = 1;
+			++marked;
+		}
+	}
+	return marked;
+}
+
+/*
+ * Arms the given timerfd to expire in the far future, but to be cancelled as 
+ * soon as the realtime clock is set discontinuously. This includes the clock 
+ * being changed by the user or NTP, as well as the system resuming from 
+ * suspend. Returns 0 on success, -1 on error.
+ */
+static int arm_clock(int fd)
+{
+	struct itimerspec its = { .it_value.tv_sec = LONG_MAX };
+	int flags = TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET;
+	return timerfd_settime(fd, flags, &its, NULL);
+}
+
+/*
+ * Creates the clock watch, which wakes us up whenever the clock jumps.
+ * Returns 0 on success, -1 on error.
+ */
+static int open_clock(state_s *state)
+{
+	int fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd == -1)
+	{
+		return -1;
+	}
+
+	if (arm_clock(fd) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+
+	state->clock = make_watch(state, fd);
+	return state->clock ? 0 : -1;
+}
+
+/*
+ * Reads from the clock's timerfd. If the read was cancelled because the clock 
+ * jumped, all timed blocks will be refreshed. The timer is re-armed in any case.
+ * Returns 1 if the clock jumped, otherwise 0.
+ */
+static int read_clock(state_s *state)
+{
+	uint64_t expirations = 0;
+	int fd = state->clock->fd;
+
+	ssize_t res = read(fd, &expirations, sizeof(expirations));
+	int jumped = (res == -1 && errno == ECANCELED);
+
+	if (jumped)
+	{
+		refresh_timed_blocks(state);
+	}
+
+	arm_clock(fd);
+	return jumped;
+}
+
+/*
+ * Checks if the system has been suspended since the last check, by comparing 
+ * how far CLOCK_BOOTTIME and CLOCK_MONOTONIC have drifted apart. If so, all 
+ * timed blocks will be refreshed. Returns 1 if a suspend was detected, else 0.
+ */
+static int check_suspend(state_s *state)
+{
+	double slept = get_slept();
+	int suspended = (slept - state->slept) > SUSPEND_TOLERANCE;
+	state->slept = slept;
+
+	if (suspended)
+	{
+		refresh_timed_blocks(state);
+	}
+	return suspended;
+}
+
+/*
+ * Returns the real-time signal number that the block wants to be run on, 
+ * as configured via its `signal` option, or 0 if it doesn't have one.
+ */
+static int block_signal(thing_s *block)
+{
+	if (!cfg_has(&block->cfg, BLOCK_OPT_SIGNAL))
+	{
+		return 0;
+	}
+
+	int sig = SIGRTMIN + cfg_get_int(&block->cfg, BLOCK_OPT_SIGNAL);
+	return (sig >= SIGRTMIN && sig <= SIGRTMAX) ? sig : 0;
+}
+
+/*
+ * Blocks all real-time signals that blocks have asked to be run on and creates
+ * a signalfd for them, so they can be processed from within the main loop. 
+ * Returns the number of signals handled, 0 if there were none, -1 on error.
+ */
+static int open_signals(state_s *state)
+{
+	sigset_t sigset;
+	sigemptyset(&sigset);
+
+	int num_signals = 0;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		int sig = block_signal(&state->blocks[i]);
+		if (sig == 0)
+		{
+			if (cfg_has(&state->blocks[i].cfg, BLOCK_OPT_SIGNAL))
+			{
+				fprintf(stderr, "open_signals(): invalid signal for block '%s'\n", state->blocks[i].sid);
+			}
+			continue;
+		}
+		if (sigismember(&sigset, sig) == 0)
+		{
+			sigaddset(&sigset, sig);
+			++num_signals;
+		}
+	}
+
+	if (num_signals == 0)
+	{
+		return 0;
+	}
+
+	// signals need to be blocked, otherwise they won't be queued for the fd
+	if (sigprocmask(SIG_BLOCK, &sigset, NULL) == -1)
+	{
+		return -1;
+	}
+
+	int fd = signalfd(-1, &sigset, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd == -1)
+	{
+		return -1;
+	}
+
+	state->signals = make_watch(state, fd);
+	return state->signals ? num_signals : -1;
+}
+
+/*
+ * Reads all pending signals from the signalfd and marks every block that has 
+ * been configured for the received signal as due. Live blocks are skipped, as 
+ * they are running anyway. Returns the number of blocks marked as due.
+ */
+static size_t read_signals(state_s *state)
+{
+	size_t marked = 0;
+	struct signalfd_siginfo info;
+
+	while (read(state->signals->fd, &info, sizeof(info)) == sizeof(info))
+	{
+		for (size_t i = 0; i < state->num_blocks; ++i)
+		{
+			thing_s *block = &state->blocks[i];
+			if (block->b_type == BLOCK_LIVE)
+			{
+				continue;
+			}
+			if (block_signal(block) == (int) info.ssi_signo)
+			{
+				block->due = 1;
+				++marked;
+			}
+		}
+	}
+	return marked;
+}
+
+/*
+ * Returns the time, in seconds, until the next block should be run.
+ * If no blocks are scheduled for execution, -1 will be returned.
+ */
+static double time_to_wait(state_s *state, double now)
+{
+	double lemon_due = DBL_MAX;
+	double thing_due = DBL_MAX;
+
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		// SIGCHLD doesn't wake us up, so blocks whose process has exited
+		// need us to check back soon, for it to be reaped
+		thing_due = block_is_unreaped(&state->blocks[i]) ? 
+			BLOCK_REAP_WAIT : block_due_in(&state->blocks[i], now);
+
+		if (thing_due < lemon_due)
+		{
+			lemon_due = thing_due;
+		}
+
+		// persistent blocks that haven't responded yet might time out
+		if (state->blocks[i].persistent && state->blocks[i].alive)
+		{
+			thing_due = state->blocks[i].last_open + PERSISTENT_TIMEOUT - now;
+			if (thing_due < lemon_due)
+			{
+				lemon_due = thing_due < 0.0 ? 0.0 : thing_due;
+			}
+		}
+	}
+
+	// socket and inotify sparks that lost their connection or watch need 
+	// to be retried
+	for (size_t i = 0; i < state->num_sparks; ++i)
+	{
+		thing_s *spark = &state->sparks[i];
+		if ((spark->s_type != SPARK_SOCKET && spark->s_type != SPARK_INOTIFY) || spark->alive)
+		{
+			continue;
+		}
+
+		thing_due = spark->last_open + spark->backoff - now;
+		if (thing_due < lemon_due)
+		{
+			lemon_due = thing_due < 0.0 ? 0.0 : thing_due;
+		}
+	}
+
+	// the shell might need to be killed or restarted
+	thing_due = shell_due_in(state->shell, now);
+	if (thing_due < lemon_due)
+	{
+		lemon_due = thing_due < 0.0 ? 0.0 : thing_due;
+	}
+
+	return (lemon_due == DBL_MAX) ? -1 : lemon_due;
+}
+
+/*
+ * Given a block, returns a malloc'd string that contains both the block's
+ * output, as well as its unit string (if any). The length (excluding the 
+ * null terminator) of the resulting string will be returned in `len` and 
+ * the additional characters, that have been added due to escaping of the 
+ * result and unit string, will be returned in `diff`, if given.
+ */
+char* resultstr(const thing_s *block, int *len, size_t *diff)
+{
+	// The 'diff' will tell us how many extra characters the string gained
+	// because of escaping '%' signs; we need this amount for the min_width 
+	// value, because while those additional characters have to be taken 
+	// into account for snprintf(), they aren't part of the visible output
+
+	const cfg_s *bcfg = &block->cfg;
+	
+	// use the formatted output, if the block has a formatter
+	const char *text = (block->fmt && block->fmt->text) ? block->fmt->text : block->output;
+
+	size_t rdiff = 0;
+	char *result = cfg_get_int(bcfg, BLOCK_OPT_RAW) ? 
+		strdup(text) : escape(text, '%', &rdiff);
+
+	size_t udiff = 0;
+	char *unit = escape(strsel(cfg_get_str(bcfg, BLOCK_OPT_UNIT), "", ""), '%', &udiff);
+
+	if (diff)
+	{
+		*diff = rdiff + udiff;
+	}
+
+	size_t output_len = strlen(result) + strlen(unit) + 1;
+	char *output = malloc(sizeof(char) * output_len);
+
+	*len = snprintf(output, output_len, "%s%s", result, unit);
+
+	free(result);
+	free(unit);
+
+	return output;
+}
+
+/*
+ * Given a block, writes a string to the given buf that is the formatted result 
+ * of this block's script output, ready to be fed to Lemonbar, including prefix,
+ * label and suffix. Returns the number of characters written to buf.
+ */
+int blockstr(const thing_s *lemon, const thing_s *block, char *buf, size_t len)
+{
+	// for convenience
+	const cfg_s *bcfg = &block->cfg;
+	const cfg_s *lcfg = &lemon->cfg;
+
+	char action_start[(5 * strlen(block->sid)) + 64];
+	char action_end[24];  
+	action_start[0] = 0;
+	action_end[0]   = 0;
+
+	// plugin blocks might handle clicks themselves
+	int clickable = block->plugin && block->plugin->api->click;
+
+	if (cfg_has(bcfg, BLOCK_OPT_CMD_LMB) || clickable)
+	{
+		strcat(action_start, "%{A1:");
+		strcat(action_start, block->sid);
+		strcat(action_start, "_lmb:}");
+		strcat(action_end, "%{A}");
+	}
+	if (cfg_has(bcfg, BLOCK_OPT_CMD_MMB) || clickable)
+	{
+		strcat(action_start, "%{A2:");
+		strcat(action_start, block->sid);
+		strcat(action_start, "_mmb:}");
+		strcat(action_end, "%{A}");
+	}
+	if (cfg_has(bcfg, BLOCK_OPT_CMD_RMB) || clickable)
+	{
+		strcat(action_start, "%{A3:");
+		strcat(action_start, block->sid);
+		strcat(action_start, "_rmb:}");
+		strcat(action_end, "%{A}");
+	}
+	if (cfg_has(bcfg, BLOCK_OPT_CMD_SUP) || clickable)
+	{
+		strcat(action_start, "%{A4:");
+		strcat(action_start, block->sid);
+		strcat(action_start, "_sup:}");
+		strcat(action_end, "%{A}");
+	}
+	if (cfg_has(bcfg, BLOCK_OPT_CMD_SDN) || clickable)
+	{
+		strcat(action_start, "%{A5:");
+		strcat(action_start, block->sid);
+		strcat(action_start, "_sdn:}");
+		strcat(action_end, "%{A}");
+	}
+
+	// TODO we're missing the UNIT option, add that! let's have the
+	//      unit have the same foreground and background color as 
+	//      the actual block result string, that should be okay.
+	//      but, be careful! the length of the unit string, plus the 
+	//      separating space, need to be taken into account when 
+	//      calculating the padding (fixed width) of the block, no?
+
+	// formatter rules that match the current output override the config
+	const fmt_s *fmt = block->fmt;
+	const char *cfg_fg = (fmt && fmt->cur_fg) ? fmt->cur_fg : cfg_get_str(bcfg, BLOCK_OPT_FG);
+	const char *cfg_bg = (fmt && fmt->cur_bg) ? fmt->cur_bg : cfg_get_str(bcfg, BLOCK_OPT_BG);
+	const char *cfg_label = (fmt && fmt->cur_label) ? fmt->cur_label : cfg_get_str(bcfg, BLOCK_OPT_LABEL);
+
+	const char *block_fg = strsel(cfg_fg,                                "-", "");
+	const char *block_bg = strsel(cfg_bg,                                "-", "");
+	const char *label_fg = strsel(cfg_get_str(bcfg, BLOCK_OPT_LABEL_FG), "-", "");
+	const char *label_bg = strsel(cfg_get_str(bcfg, BLOCK_OPT_LABEL_BG), "-", "");
+	const char *affix_fg = strsel(cfg_get_str(bcfg, BLOCK_OPT_AFFIX_FG), "-", "");
+	const char *affix_bg = strsel(cfg_get_str(bcfg, BLOCK_OPT_AFFIX_BG), "-", "");
+	const char *lc       = strsel(cfg_get_str(bcfg, BLOCK_OPT_LC),       "-", "");
+
+	int font_count = 0;
+
+	char block_font_idx = cfg_get_str(lcfg, LEMON_OPT_BLOCK_FONT) ? (++font_count) + '0' : '-'; // 1st slot
+	char label_font_idx = cfg_get_str(lcfg, LEMON_OPT_LABEL_FONT) ? (++font_count) + '0' : '-'; // 2nd slot
+	char affix_font_idx = cfg_get_str(lcfg, LEMON_OPT_AFFIX_FONT) ? (++font_count) + '0' : '-'; // 3rd slot
+
+	const char *prefix   = strsel(cfg_get_str(bcfg, BLOCK_OPT_PREFIX), "", "");
+	const char *suffix   = strsel(cfg_get_str(bcfg, BLOCK_OPT_SUFFIX), "", "");
+	const char *label    = strsel(cfg_label,                        "", "");
+
+	int padding_l = cfg_get_int(bcfg, BLOCK_OPT_PADDING_LEFT);
+	int padding_r = cfg_get_int(bcfg, BLOCK_OPT_PADDING_RIGHT);
+	int margin_l  = cfg_get_int(bcfg, BLOCK_OPT_MARGIN_LEFT);
+	int margin_r  = cfg_get_int(bcfg, BLOCK_OPT_MARGIN_RIGHT);
+	int ol        = cfg_get_int(bcfg, BLOCK_OPT_OL);
+	int ul        = cfg_get_int(bcfg, BLOCK_OPT_UL);
+
+	int     rlen      = 0;
+	size_t  rdiff     = 0;
+	char   *result    = resultstr(block, &rlen, &rdiff);
+	int     min_width = cfg_get_int(bcfg, BLOCK_OPT_MIN_WIDTH) + rdiff;
+
+	// TODO currently we are adding the format thingies for label, 
+	//      prefix and suffix, even if those are empty anyway, which
+	//      makes the string much longer than it needs to be, hence 
+	//      also increasing the parsing workload for lemonbar.
+	//      but of course, replacing a couple bytes with lots of malloc
+	//      would not be great either, so... not sure about it yet.
+
+	// TODO bug! bug! bug! we just used font slots 1 to 3 here, but maybe
+	//      we're only loading one or two (or zero) fonts! NO BUENO!
+
+	int res = snprintf(buf, len,
+		"%%{O%d}"                                      // margin left
+		"%s"                                           // action start
+		"%%{F%s B%s U%s %co %cu}"                      // format start
+		"%%{T%c F%s B%s}%s"                            // prefix
+		"%%{T%c F%s B%s}%s"                            // label
+		"%%{T%c F%s B%s}%*s%*s%*s"                     // block
+		"%%{T%c F%s B%s}%s"                            // suffix
+		"%%{T- F- B- U- -o -u}"                        // format end
+		"%s"                                           // action end
+		"%%{O%d}",                                     // margin right
+		// margin left
+		margin_l,
+		// action start
+		action_start,
+		// format start       
+		block_fg, block_bg, lc, (ol ? '+' : '-'), (ul ? '+' : '-'),
+		// prefix
+		affix_font_idx, affix_fg, affix_bg, prefix,
+		// label
+		label_font_idx, label_fg, label_bg, label,
+		// block
+		block_font_idx, block_fg, block_bg, padding_l, "", min_width, result, padding_r, "",
+		// suffix
+		affix_font_idx, affix_fg, affix_bg, suffix,
+		// action end
+		action_end,
+		// margin right
+		margin_r
+	);
+
+	free(result);
+	return res;
+}
+
+/*
+ * Returns 'l', 'c' or 'r' for input values -1, 0 and 1 respectively.
+ * For other input values, the behavior is undefined.
+ */
+static char get_align(const int align)
+{
+	char a[] = {'l', 'c', 'r'};
+	return a[align+1]; 
+}
+
+/*
+ * Combines the results of all given blocks into a single string that can be fed
+ * to Lemonbar. Returns a pointer to the string, allocated with malloc().
+ */
+static char *barstr(const state_s *state)
+{
+	// This should never happen, but just in case (also makes compiler happy)
+	if (state->num_blocks == 0)
+	{
+		return NULL;
+	}
+	
+	// For convenience
+	size_t num_blocks = state->num_blocks;
+
+	// String to place in between any two blocks
+	char *sep = cfg_get_str(&state->lemon.cfg, LEMON_OPT_SEPARATOR);
+	size_t sep_len = sep ? strlen(sep) : 0;
+
+	// Short blocks like temperature, volume or battery, will usually use 
+	// something in the range of 130 to 200 byte. So let's go with 256 byte.
+	size_t bar_str_len = BUFFER_BLOCK_RESULT * num_blocks;
+	char *bar_str = malloc(bar_str_len);
+	bar_str[0] = '\0';
+
+	char align[5];
+	int last_align = -1;
+
+	char block_str[BUFFER_BLOCK_STR];
+	const thing_s *block = NULL;
+	for (size_t i = 0; i < num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+
+		// Live blocks might not have a result available
+		if (block->output == NULL)
+		{
+			continue;
+		}
+
+		// Multiplexed blocks only feed other blocks
+		if (cfg_get_int(&block->cfg, BLOCK_OPT_MULTIPLEX))
+		{
+			continue;
+		}
+
+		// Figure out the alignment of this block
+		int block_align = cfg_get_int(&block->cfg, BLOCK_OPT_ALIGN);
+		int same_align = block_align == last_align;
+
+		// Build the block string
+		int block_str_len = blockstr(&state->lemon, block, block_str, BUFFER_BLOCK_STR);
+
+		// Potentially change the alignment
+		if (!same_align)
+		{
+			last_align = block_align;
+			snprintf(align, 5, "%%{%c}", get_align(last_align));
+			strcat(bar_str, align);
+		}
+		
+		// Let's check if this block string can fit in our buffer
+		size_t free_len = bar_str_len - (strlen(bar_str) + sep_len + 1);
+		if (block_str_len > free_len)
+		{
+			// Let's make space for approx. two more blocks
+			bar_str_len += BUFFER_BLOCK_RESULT * 2; 
+			bar_str = realloc(bar_str, bar_str_len);
+		}
+
+		// Possibly add the block separator in front of the block
+		if (sep && same_align && i)
+		{
+			strcat(bar_str, sep);
+		}
+
+		// Add this block's result to the bar string
+		strcat(bar_str, block_str);
+	}
+
+	strcat(bar_str, "\n");
+	bar_str = realloc(bar_str, strlen(bar_str) + 1);
+	return bar_str;
+}
+
+/*
+ * Parses the format string for the bar, which should contain block names 
+ * separated by whitespace and, optionally, up to two vertical bars to indicate 
+ * alignment of blocks. For every block name found, the callback function `cb` 
+ * will be run. Returns the number of block names found.
+ */
+static size_t parse_format(const char *format, create_block_callback cb, void *data)
+{
+	if (format == NULL)
+	{
+		return 0;
+	}
+
+	size_t format_len = strlen(format) + 1;
+	char block_name[BUFFER_BLOCK_NAME];
+	block_name[0] = '\0';
+	size_t block_name_len = 0;
+	int block_align = -1;
+	int num_blocks = 0;
+
+	for (size_t i = 0; i < format_len; ++i)
+	{
+		switch (format[i])
+		{
+		case '|':
+			// Next align
+			block_align += block_align < 1;
+			break;
+		case ' ':
+		case '\0':
+			if (block_name_len)
+			{
+				// Block name complete, inform the callback
+				cb(block_name, block_align, data);
+				// Prepare for the next block name
+				block_name[0] = '\0';
+				block_name_len = 0;
+			}
+			break;
+		default:
+			// Add the char to the current's block name
+			block_name[block_name_len++] = format[i];
+			block_name[block_name_len]   = '\0';
+		}
+	}
+
+	// Return the number of blocks found
+	return num_blocks;
+}
+
+static kita_child_s* make_child(state_s *state, const char *cmd, int in, int out, int err)
+{
+	// Create child process
+	kita_child_s *child = kita_child_new(cmd, in, out, err);
+	if (child == NULL)
+	{
+		return NULL;
+	}
+
+	// Add the child to the kita 
+	if (kita_child_add(state->kita, child) == -1)
+	{
+		kita_child_free(&child);
+		return NULL;
+	}
+
+	kita_child_set_context(child, state);
+	return child;
+}
+
+/*
+ * Finds and returns the block with the given `sid` -- or NULL.
+ */
+static thing_s *get_block(const state_s *state, const char *sid)
+{
+	// Iterate over all existing blocks and check for a name match
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		// If names match, return a pointer to this block
+		if (equals(state->blocks[i].sid, sid))
+		{
+			return &state->blocks[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Add the block with the given SID to the collection of blocks, unless there 
+ * is already a block with that SID present. 
+ * Returns a pointer to the added (or existing) block or NULL in case of error.
+ */
+static thing_s *add_block(state_s *state, const char *sid)
+{
+	// See if there is an existing block by this name (and return, if so)
+	thing_s *eb = get_block(state, sid);
+	if (eb)
+	{
+		return eb;
+	}
+
+	// Resize the block container to be able to hold one more block
+	size_t current  =   state->num_blocks;
+	size_t new_size = ++state->num_blocks * sizeof(thing_s);
+	thing_s *blocks = realloc(state->blocks, new_size);
+	if (blocks == NULL)
+	{
+		fprintf(stderr, "add_block(): realloc() failed!\n");
+		--state->num_blocks;
+		return NULL;
+	}
+	state->blocks = blocks;
+
+	// Create the block, setting its name and default values
+	state->blocks[current] = (thing_s) { 0 };
+	state->blocks[current].sid    = strdup(sid);
+	state->blocks[current].t_type = THING_BLOCK;
+	state->blocks[current].b_type = BLOCK_ONCE;
+	cfg_init(&state->blocks[current].cfg, "default", BLOCK_OPT_COUNT);
+
+	// Return a pointer to the new block
+	return &state->blocks[current];
+}
+
+/*
+ * Creates the run conditions for the given block from its config, if it has 
+ * any `run-if-*` options set. Patterns are compiled once, right here. 
+ * Returns 0 on success (or if there are no conditions), -1 on error.
+ */
+static int init_cond(const state_s *state, thing_s *block)
+{
+	const cfg_s *bcfg = &block->cfg;
+	if (!cfg_has(bcfg, BLOCK_OPT_IF_CHANGED) && !cfg_has(bcfg, BLOCK_OPT_IF_OUTPUT) &&
+	    !cfg_has(bcfg, BLOCK_OPT_IF_EXISTS)  && !cfg_has(bcfg, BLOCK_OPT_IF_MISSING) &&
+	    !cfg_has(bcfg, BLOCK_OPT_TRIG_MATCH) && !cfg_has(bcfg, BLOCK_OPT_TRIG_IGNORE) &&
+	    !cfg_get_int(bcfg, BLOCK_OPT_TRIG_DISTINCT))
+	{
+		return 0;
+	}
+
+	cond_s *cond = malloc(sizeof(cond_s));
+	if (cond == NULL)
+	{
+		return -1;
+	}
+	*cond = (cond_s) { 0 };
+	cond->changed = cfg_get_str(bcfg, BLOCK_OPT_IF_CHANGED);
+	block->cond = cond;
+
+	// trigger filters are plain regular expressions
+	const char *match = cfg_get_str(bcfg, BLOCK_OPT_TRIG_MATCH);
+	if (match)
+	{
+		if (regcomp(&cond->match, match, REG_EXTENDED | REG_NOSUB) != 0)
+		{
+			fprintf(stderr, "init_cond(): invalid pattern in trigger-match of '%s'\n", block->sid);
+			return -1;
+		}
+		cond->has_match = 1;
+	}
+
+	const char *ignore = cfg_get_str(bcfg, BLOCK_OPT_TRIG_IGNORE);
+	if (ignore)
+	{
+		if (regcomp(&cond->ignore, ignore, REG_EXTENDED | REG_NOSUB) != 0)
+		{
+			fprintf(stderr, "init_cond(): invalid pattern in trigger-ignore of '%s'\n", block->sid);
+			return -1;
+		}
+		cond->has_ignore = 1;
+	}
+
+	// `run-if-output` has the format [!]<block>:<regex>
+	const char *output = cfg_get_str(bcfg, BLOCK_OPT_IF_OUTPUT);
+	if (output == NULL)
+	{
+		return 0;
+	}
+
+	cond->negate = output[0] == '!';
+	const char *name = output + cond->negate;
+	const char *sep  = strchr(name, ':');
+	if (sep == NULL || sep == name)
+	{
+		fprintf(stderr, "init_cond(): invalid run-if-output for block '%s'\n", block->sid);
+		return -1;
+	}
+
+	char sid[sep - name + 1];
+	snprintf(sid, sizeof(sid), "%s", name);
+	thing_s *other = get_block(state, sid);
+	if (other == NULL || other == block)
+	{
+		fprintf(stderr, "init_cond(): unknown block '%s' in run-if-output of '%s'\n", sid, block->sid);
+		return -1;
+	}
+
+	if (regcomp(&cond->regex, sep + 1, REG_EXTENDED | REG_NOSUB) != 0)
+	{
+		fprintf(stderr, "init_cond(): invalid pattern in run-if-output of '%s'\n", block->sid);
+		return -1;
+	}
+	cond->block = other;
+	return 0;
+}
+
+/*
+ * Blocks that run the same command in the same way (same type, interval, 
+ * trigger, run conditions and filters) would produce the same output, hence they can 
+ * share one child process. Returns the first block, before the given one, 
+ * that has a child process running `cmd` the same way, or NULL if none.
+ */
+static thing_s *get_host(const state_s *state, const thing_s *block, const char *cmd)
+{
+	static const block_opt_e opts[] = {
+		BLOCK_OPT_RELOAD, BLOCK_OPT_TRIGGER, BLOCK_OPT_CONSUME, BLOCK_OPT_SIGNAL,
+		BLOCK_OPT_DEBOUNCE, BLOCK_OPT_TRIG_MATCH, BLOCK_OPT_TRIG_IGNORE, BLOCK_OPT_TRIG_DISTINCT,
+		BLOCK_OPT_IF_CHANGED, BLOCK_OPT_IF_EXISTS, BLOCK_OPT_IF_MISSING, BLOCK_OPT_IF_OUTPUT,
+		BLOCK_OPT_MULTIPLEX, BLOCK_OPT_FIELD, BLOCK_OPT_SPLIT, BLOCK_OPT_REGEX, BLOCK_OPT_TR,
+		BLOCK_OPT_TRIM, BLOCK_OPT_MAX_LENGTH, BLOCK_OPT_PERSISTENT
+	};
+
+	for (const thing_s *other = state->blocks; other < block; ++other)
+	{
+		if (other->child == NULL || other->b_type != block->b_type)
+		{
+			continue;
+		}
+		if (!equals(other->child->cmd, cmd))
+		{
+			continue;
+		}
+
+		int same = 1;
+		for (size_t o = 0; same && o < sizeof(opts) / sizeof(opts[0]); ++o)
+		{
+			same = cfg_same(&other->cfg, &block->cfg, opts[o]);
+		}
+		if (same)
+		{
+			return (thing_s *) other;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Points all sourced blocks to the multiplexed block they get their output 
+ * from, via their `other` field. Returns the number of blocks linked.
+ */
+static size_t link_sources(state_s *state)
+{
+	size_t linked = 0;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		thing_s *block = &state->blocks[i];
+		if (block->b_type != BLOCK_SOURCED)
+		{
+			continue;
+		}
+
+		const char *source = cfg_get_str(&block->cfg, BLOCK_OPT_SOURCE);
+		block->other = get_block(state, source);
+		if (block->other == NULL || !cfg_get_int(&block->other->cfg, BLOCK_OPT_MULTIPLEX))
+		{
+			fprintf(stderr, "link_sources(): '%s' is not a multiplexed block in the bar\n", source);
+			block->other = NULL;
+			continue;
+		}
+		++linked;
+	}
+	return linked;
+}
+
+/*
+ * inih doc: "Handler should return nonzero on success, zero on error."
+ */
+int lemon_cfg_handler(void *data, const char *section, const char *name, const char *value)
+{
+	state_s *state = (state_s*) data;
+
+	// Only process if section is empty or specificially for bar
+	if (empty(section) || equals(section, state->lemon.sid))
+	{
+		return lemon_ini_handler(&state->lemon, section, name, value);
+	}
+
+	return 1;
+}
+
+/*
+ * inih doc: "Handler should return nonzero on success, zero on error."
+ */
+int block_cfg_handler(void *data, const char *section, const char *name, const char *value)
+{
+	state_s *state = (state_s*) data;
+
+	// Abort if section is empty or specifically for bar
+	if (empty(section) || (equals(section, state->lemon.sid)))
+	{
+		return 1;
+	}
+
+	// Find the block whose name fits the section name
+	thing_s *block = equals(section, ALBEDO_SID) ? &state->albedo : get_block(state, section);
+
+	// Abort if we couldn't find that block
+	if (block == NULL)
+	{
+		return 1;
+	}
+
+	// Process via the appropriate handler
+	return block_ini_handler(block, section, name, value);
+}
+
+/*
+ * Load the config and parse the section for the bar, ignoring other sections.
+ * Returns 0 on success, -1 on file open error, -2 on memory allocation error, 
+ * -3 if no config file path was given in the preferences, or the line number 
+ * of the first encountered parse error.
+ */
+static int load_lemon_cfg(state_s *state)
+{
+	// Abort if config file path empty or NULL
+	if (empty(state->prefs.config))
+	{
+		return -3;
+	}
+
+	// Fire up the INI parser
+	return ini_parse(state->prefs.config, lemon_cfg_handler, state);
+}
+
+/*
+ * Load the config and parse all sections apart from the bar section.
+ * Returns 0 on success, -1 on file open error, -2 on memory allocation error, 
+ * -3 if no config file path was given in the preferences, or the line number 
+ * of the first encountered parse error.
+ */
+static int load_block_cfg(state_s *state)
+{
+	// Abort if config file path empty or NULL
+	if (empty(state->prefs.config))
+	{
+		return -3;
+	}
+
+	return ini_parse(state->prefs.config, block_cfg_handler, state);
+}
+
+/*
+ * Finds and returns the spark for the trigger command `cmd` -- or NULL.
+ * Sparks are identified by their trigger command alone, so that all blocks 
+ * using the same trigger can subscribe to one and the same spark.
+ */
+static thing_s *get_spark(const state_s *state, const char *cmd)
+{
+	for (size_t i = 0; i < state->num_sparks; ++i)
+	{
+		if (equals(state->sparks[i].sid, cmd))
+		{
+			return &state->sparks[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Add a spark for the trigger command `cmd` to the collection of sparks, 
+ * unless there is already a spark for that command present.
+ * Returns a pointer to the added (or existing) spark or NULL in case of error.
+ * Note that adding a spark might move all sparks in memory.
+ */
+static thing_s *add_spark(state_s *state, const char *cmd)
+{
+	// See if there is an existing spark for this trigger command
+	thing_s *es = get_spark(state, cmd);
+	if (es)
+	{
+		return es;
+	}
+
+	// Resize the spark array to be able to hold one more spark
+	size_t current  =   state->num_sparks;
+	size_t new_size = ++state->num_sparks * sizeof(thing_s);
+	thing_s *sparks = realloc(state->sparks, new_size);
+	if (sparks == NULL)
+	{
+		fprintf(stderr, "add_spark(): realloc() failed!\n");
+		--state->num_sparks;
+		return NULL;
+	}
+	state->sparks = sparks; 
+	 
+	// The trigger command doubles as the spark's ID
+	state->sparks[current] = (thing_s) { 0 };
+	state->sparks[current].sid    = strdup(cmd);
+	state->sparks[current].t_type = THING_SPARK;
+	state->sparks[current].s_type = SPARK_CHILD;
+	state->sparks[current].wd     = -1;
+
+	// Triggers with a known prefix are handled natively, without a child
+	if (has_prefix(cmd, SPARK_PREFIX_INOTIFY))
+	{
+		state->sparks[current].s_type = SPARK_INOTIFY;
+	}
+	else if (has_prefix(cmd, SPARK_PREFIX_UEVENT))
+	{
+		state->sparks[current].s_type = SPARK_UEVENT;
+	}
+	else if (has_prefix(cmd, SPARK_PREFIX_NETLINK))
+	{
+		state->sparks[current].s_type = SPARK_NETLINK;
+	}
+	else if (has_prefix(cmd, SPARK_PREFIX_SOCKET))
+	{
+		state->sparks[current].s_type = SPARK_SOCKET;
+	}
+	else if (has_prefix(cmd, SPARK_PREFIX_BLOCK))
+	{
+		state->sparks[current].s_type = SPARK_BLOCK;
+	}
+
+	// Return a pointer to the new spark
+	return &state->sparks[current];
+}
+
+/*
+ * Translates a comma-separated list of inotify event names into an event mask.
+ * Returns the mask, which will be 0 if none of the event names were known.
+ */
+static unsigned inotify_mask(const char *events)
+{
+	static const struct { const char *name; unsigned mask; } names[] = {
+		{ "access",      IN_ACCESS },      { "modify",     IN_MODIFY },
+		{ "attrib",      IN_ATTRIB },      { "close_write", IN_CLOSE_WRITE },
+		{ "close_nowrite", IN_CLOSE_NOWRITE }, { "close",  IN_CLOSE },
+		{ "open",        IN_OPEN },        { "moved_from", IN_MOVED_FROM },
+		{ "moved_to",    IN_MOVED_TO },    { "move",       IN_MOVE },
+		{ "create",      IN_CREATE },      { "delete",     IN_DELETE },
+		{ "delete_self", IN_DELETE_SELF }, { "move_self",  IN_MOVE_SELF }
+	};
+
+	unsigned mask = 0;
+	size_t len = strlen(events);
+	char list[len + 1];
+	snprintf(list, len + 1, "%s", events);
+
+	char *save = NULL;
+	for (char *ev = strtok_r(list, ",", &save); ev; ev = strtok_r(NULL, ",", &save))
+	{
+		for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); ++n)
+		{
+			if (equals(ev, names[n].name))
+			{
+				mask |= names[n].mask;
+			}
+		}
+	}
+	return mask;
+}
+
+/*
+ * Returns a string representation of the first event found in the given 
+ * inotify event mask, as used by inotify_mask() and inotifywait.
+ */
+static const char *inotify_event(unsigned mask)
+{
+	if (mask & IN_ACCESS)        return "access";
+	if (mask & IN_MODIFY)        return "modify";
+	if (mask & IN_ATTRIB)        return "attrib";
+	if (mask & IN_CLOSE_WRITE)   return "close_write";
+	if (mask & IN_CLOSE_NOWRITE) return "close_nowrite";
+	if (mask & IN_OPEN)          return "open";
+	if (mask & IN_MOVED_FROM)    return "moved_from";
+	if (mask & IN_MOVED_TO)      return "moved_to";
+	if (mask & IN_CREATE)        return "create";
+	if (mask & IN_DELETE)        return "delete";
+	if (mask & IN_DELETE_SELF)   return "delete_self";
+	if (mask & IN_MOVE_SELF)     return "move_self";
+	return "ignored";
+}
+
+/*
+ * Creates the inotify instance shared by all inotify sparks and adds it to 
+ * the kita state, unless it already exists. Returns 0 on success, -1 on error.
+ */
+static int open_inotify(state_s *state)
+{
+	if (state->inotify)
+	{
+		return 0;
+	}
+
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd == -1)
+	{
+		return -1;
+	}
+
+	state->inotify = make_watch(state, fd);
+	return state->inotify ? 0 : -1;
+}
+
+/*
+ * Adds an inotify watch for the given spark, whose ID is expected to have the 
+ * format `inotify:/path[:events]`, where events is a comma-separated list like 
+ * `modify,create`. Without events, all changes to the path will be reported.
+ * Returns 0 on success, -1 on error.
+ */
+static int add_inotify(state_s *state, thing_s *spark)
+{
+	if (open_inotify(state) == -1)
+	{
+		return -1;
+	}
+
+	const char *spec = spark->sid + strlen(SPARK_PREFIX_INOTIFY);
+	size_t len = strlen(spec);
+	char path[len + 1];
+	snprintf(path, len + 1, "%s", spec);
+
+	// a trailing `:events` is recognized as such if it doesn't look like a path
+	spark->mask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE | IN_CREATE | IN_DELETE;
+	char *events = strrchr(path, ':');
+	if (events && strchr(events, '/') == NULL)
+	{
+		*events++ = '\0';
+		spark->mask = inotify_mask(events);
+	}
+
+	if (spark->mask == 0)
+	{
+		return -1;
+	}
+
+	// several sparks might watch the same path, hence IN_MASK_ADD
+	spark->wd = inotify_add_watch(state->inotify->fd, path, spark->mask | IN_MASK_ADD);
+	if (spark->wd == -1)
+	{
+		return -1;
+	}
+
+	spark->alive = 1;
+	return 0;
+}
+
+/*
+ * Reads all pending events from the inotify instance and feeds them to all 
+ * sparks watching the affected path for this kind of event, as a line in the 
+ * format `EVENT [NAME]`, similar to inotifywait. NAME is only given for events 
+ * on files within a watched directory. Returns the number of events read.
+ */
+static size_t read_inotify(state_s *state)
+{
+	char buf[BUFFER_INOTIFY] __attribute__((aligned(__alignof__(struct inotify_event))));
+	size_t num_events = 0;
+	double now = get_time();
+	ssize_t len;
+
+	while ((len = read(state->inotify->fd, buf, sizeof(buf))) > 0)
+	{
+		const struct inotify_event *ev = NULL;
+		for (char *ptr = buf; ptr < buf + len; ptr += sizeof(*ev) + ev->len)
+		{
+			ev = (const struct inotify_event *) ptr;
+			++num_events;
+
+			for (size_t i = 0; i < state->num_sparks; ++i)
+			{
+				thing_s *spark = &state->sparks[i];
+				if (spark->s_type != SPARK_INOTIFY || spark->wd != ev->wd)
+				{
+					continue;
+				}
+
+				// the watched path is gone (deleted, or replaced via
+				// rename), reconnect_sparks() will watch it again
+				if (ev->mask & IN_IGNORED)
+				{
+					spark->alive = 0;
+					spark->wd = -1;
+					continue;
+				}
+
+				if ((ev->mask & spark->mask) == 0)
+				{
+					continue;
+				}
+
+				char line[BUFFER_BLOCK_RESULT];
+				snprintf(line, sizeof(line), "%s%s%s", inotify_event(ev->mask & spark->mask),
+						ev->len ? " " : "", ev->len ? ev->name : "");
+				spark->last_read = now;
+				feed_spark(state, spark, line);
+			}
+		}
+	}
+	return num_events;
+}
+
+/*
+ * Opens a netlink socket of the given protocol, bound to the given multicast 
+ * groups, and wraps it in a kita watch. Returns the watch or NULL on error.
+ */
+static kita_watch_s *open_netlink(state_s *state, int protocol, unsigned groups)
+{
+	int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
+	if (fd == -1)
+	{
+		return NULL;
+	}
+
+	struct sockaddr_nl addr = { .nl_family = AF_NETLINK, .nl_groups = groups };
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	return make_watch(state, fd);
+}
+
+/*
+ * Sets up the given uevent spark, whose ID is expected to have the format 
+ * `uevent:[subsystem]`, like `uevent:power_supply`. Without a subsystem, all 
+ * kernel uevents will be reported. All uevent sparks share one socket.
+ * Returns 0 on success, -1 on error.
+ */
+static int add_uevent(state_s *state, thing_s *spark)
+{
+	if (state->uevent == NULL)
+	{
+		// multicast group 1 receives the kernel's uevents
+		state->uevent = open_netlink(state, NETLINK_KOBJECT_UEVENT, 1);
+	}
+
+	spark->alive = (state->uevent != NULL);
+	return spark->alive ? 0 : -1;
+}
+
+/*
+ * Reads all pending kernel uevents and feeds them, as lines in the format 
+ * `ACTION DEVPATH`, to all uevent sparks interested in the event's subsystem.
+ * Returns the number of uevents read.
+ */
+static size_t read_uevent(state_s *state)
+{
+	char buf[BUFFER_NETLINK];
+	size_t num_events = 0;
+	double now = get_time();
+	ssize_t len;
+
+	while ((len = recv(state->uevent->fd, buf, sizeof(buf) - 1, 0)) > 0)
+	{
+		buf[len] = '\0';
+		++num_events;
+
+		// message is `action@devpath\0` followed by `KEY=value\0` pairs
+		const char *action = "", *devpath = "", *subsystem = "";
+		for (char *kv = buf + strlen(buf) + 1; kv < buf + len; kv += strlen(kv) + 1)
+		{
+			if (has_prefix(kv, "ACTION="))    action    = kv + strlen("ACTION=");
+			if (has_prefix(kv, "DEVPATH="))   devpath   = kv + strlen("DEVPATH=");
+			if (has_prefix(kv, "SUBSYSTEM=")) subsystem = kv + strlen("SUBSYSTEM=");
+		}
+
+		for (size_t i = 0; i < state->num_sparks; ++i)
+		{
+			thing_s *spark = &state->sparks[i];
+			if (spark->s_type != SPARK_UEVENT)
+			{
+				continue;
+			}
+
+			const char *wanted = spark->sid + strlen(SPARK_PREFIX_UEVENT);
+			if (!empty(wanted) && !equals(wanted, subsystem))
+			{
+				continue;
+			}
+
+			char line[BUFFER_BLOCK_RESULT];
+			snprintf(line, sizeof(line), "%s %s", action, devpath);
+			spark->last_read = now;
+			feed_spark(state, spark, line);
+		}
+	}
+	return num_events;
+}
+
+/*
+ * Sets up the given netlink spark, whose ID is expected to have the format 
+ * `netlink:kinds`, where kinds is a comma-separated list of `link`, `addr` 
+ * and `route`. All netlink sparks share one NETLINK_ROUTE socket, which will 
+ * join the multicast groups required for the requested kinds of messages.
+ * Returns 0 on success, -1 on error.
+ */
+static int add_netlink(state_s *state, thing_s *spark)
+{
+	static const struct { const char *name; unsigned groups[2]; } kinds[] = {
+		{ "link",  { RTNLGRP_LINK,       RTNLGRP_LINK       } },
+		{ "addr",  { RTNLGRP_IPV4_IFADDR, RTNLGRP_IPV6_IFADDR } },
+		{ "route", { RTNLGRP_IPV4_ROUTE, RTNLGRP_IPV6_ROUTE } }
+	};
+
+	if (state->netlink == NULL)
+	{
+		state->netlink = open_netlink(state, NETLINK_ROUTE, 0);
+		if (state->netlink == NULL)
+		{
+			return -1;
+		}
+	}
+
+	const char *spec = spark->sid + strlen(SPARK_PREFIX_NETLINK);
+	size_t len = strlen(spec);
+	char list[len + 1];
+	snprintf(list, len + 1, "%s", spec);
+
+	char *save = NULL;
+	for (char *kind = strtok_r(list, ",", &save); kind; kind = strtok_r(NULL, ",", &save))
+	{
+		for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); ++k)
+		{
+			if (!equals(kind, kinds[k].name))
+			{
+				continue;
+			}
+			for (int g = 0; g < 2; ++g)
+			{
+				unsigned group = kinds[k].groups[g];
+				setsockopt(state->netlink->fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, 
+						&group, sizeof(group));
+				spark->mask |= 1u << group;
+			}
+		}
+	}
+
+	spark->alive = (spark->mask != 0);
+	return spark->alive ? 0 : -1;
+}
+
+/*
+ * Reads all pending NETLINK_ROUTE messages and feeds them, as lines in the 
+ * format `TYPE IFNAME [STATE]`, like `newlink wlan0 up` or `deladdr eth0`, to 
+ * all netlink sparks interested in that kind of message. 
+ * Returns the number of messages read.
+ */
+static size_t read_netlink(state_s *state)
+{
+	char buf[BUFFER_NETLINK] __attribute__((aligned(__alignof__(struct nlmsghdr))));
+	size_t num_msgs = 0;
+	double now = get_time();
+	ssize_t len;
+
+	while ((len = recv(state->netlink->fd, buf, sizeof(buf), 0)) > 0)
+	{
+		for (struct nlmsghdr *nh = (struct nlmsghdr *) buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len))
+		{
+			char ifname[IF_NAMESIZE] = { 0 };
+			char line[BUFFER_BLOCK_RESULT];
+			unsigned mask = 0;
+
+			switch (nh->nlmsg_type)
+			{
+				case RTM_NEWLINK:
+				case RTM_DELLINK:
+				{
+					struct ifinfomsg *ifi = NLMSG_DATA(nh);
+					if_indextoname(ifi->ifi_index, ifname);
+					int up = (ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_RUNNING);
+					snprintf(line, sizeof(line), "%s %s %s", 
+							nh->nlmsg_type == RTM_NEWLINK ? "newlink" : "dellink",
+							ifname, up ? "up" : "down");
+					mask = 1u << RTNLGRP_LINK;
+					break;
+				}
+				case RTM_NEWADDR:
+				case RTM_DELADDR:
+				{
+					struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+					if_indextoname(ifa->ifa_index, ifname);
+					snprintf(line, sizeof(line), "%s %s", 
+							nh->nlmsg_type == RTM_NEWADDR ? "newaddr" : "deladdr", ifname);
+					mask = (1u << RTNLGRP_IPV4_IFADDR) | (1u << RTNLGRP_IPV6_IFADDR);
+					break;
+				}
+				case RTM_NEWROUTE:
+				case RTM_DELROUTE:
+				{
+					struct rtmsg *rtm = NLMSG_DATA(nh);
+					int rlen = RTM_PAYLOAD(nh);
+					for (struct rtattr *rta = RTM_RTA(rtm); RTA_OK(rta, rlen); rta = RTA_NEXT(rta, rlen))
+					{
+						if (rta->rta_type == RTA_OIF)
+						{
+							if_indextoname(*(int *) RTA_DATA(rta), ifname);
+						}
+					}
+					snprintf(line, sizeof(line), "%s %s", 
+							nh->nlmsg_type == RTM_NEWROUTE ? "newroute" : "delroute", ifname);
+					mask = (1u << RTNLGRP_IPV4_ROUTE) | (1u << RTNLGRP_IPV6_ROUTE);
+					break;
+				}
+				default:
+					continue;
+			}
+
+			++num_msgs;
+			for (size_t i = 0; i < state->num_sparks; ++i)
+			{
+				thing_s *spark = &state->sparks[i];
+				if (spark->s_type == SPARK_NETLINK && (spark->mask & mask))
+				{
+					char copy[BUFFER_BLOCK_RESULT];
+					snprintf(copy, sizeof(copy), "%s", line);
+					spark->last_read = now;
+					feed_spark(state, spark, copy);
+				}
+			}
+		}
+	}
+	return num_msgs;
+}
+
+/*
+ * Parses the ID of the given socket spark, which is expected to have the 
+ * format `socket:/path[:greeting]`. Writes the path to `path` and the greeting, 
+ * with the escape sequences `\n`, `\t` and `\0` resolved, to `greeting`, 
+ * which may be NULL if `greeting_len` is 0. Returns the length of the greeting
+ * in bytes, which might contain nulls.
+ */
+static size_t socket_spec(const thing_s *spark, char *path, size_t path_len, char *greeting, size_t greeting_len)
+{
+	const char *spec = spark->sid + strlen(SPARK_PREFIX_SOCKET);
+	const char *sep  = strchr(spec, ':');
+
+	size_t len = sep ? (size_t) (sep - spec) : strlen(spec);
+	snprintf(path, path_len, "%.*s", (int) len, spec);
+
+	size_t g = 0;
+	for (const char *c = sep ? sep + 1 : ""; *c && g < greeting_len; ++c)
+	{
+		if (*c == '\\' && c[1])
+		{
+			switch (*++c)
+			{
+				case 'n': greeting[g++] = '\n'; break;
+				case 't': greeting[g++] = '\t'; break;
+				case '0': greeting[g++] = '\0'; break;
+				default:  greeting[g++] = *c;   break;
+			}
+			continue;
+		}
+		greeting[g++] = *c;
+	}
+	return g;
+}
+
+/*
+ * Doubles the time to wait before the given socket or inotify spark's next 
+ * attempt to connect or to watch its path again, starting at SPARK_BACKOFF_MIN
+ * and capped at SPARK_BACKOFF_MAX.
+ */
+static void backoff_spark(thing_s *spark)
+{
+	spark->backoff *= 2.0;
+	if (spark->backoff < SPARK_BACKOFF_MIN)
+	{
+		spark->backoff = SPARK_BACKOFF_MIN;
+	}
+	if (spark->backoff > SPARK_BACKOFF_MAX)
+	{
+		spark->backoff = SPARK_BACKOFF_MAX;
+	}
+}
+
+/*
+ * Drops the connection of the given socket spark, discarding any incomplete 
+ * line, and increases the time until the next connection attempt.
+ */
+static void close_socket(thing_s *spark)
+{
+	free_watch(&spark->watch);
+	free(spark->partial);
+	spark->partial = NULL;
+	spark->alive = 0;
+	backoff_spark(spark);
+}
+
+/*
+ * Sends as much of the given socket spark's greeting, if any, as the connection
+ * will take without blocking. Returns 1 if some of it is yet to be sent, 0 if 
+ * all of it has been sent, -1 on error.
+ */
+static int greet_socket(thing_s *spark)
+{
+	struct sockaddr_un addr;
+	char greeting[BUFFER_SOCKET];
+	size_t greeting_len = socket_spec(spark, addr.sun_path, sizeof(addr.sun_path), 
+			greeting, sizeof(greeting));
+
+	while (spark->greeted < greeting_len)
+	{
+		ssize_t n = send(spark->watch->fd, greeting + spark->greeted, 
+				greeting_len - spark->greeted, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (n == -1)
+		{
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 1 : -1;
+		}
+		spark->greeted += n;
+	}
+	return 0;
+}
+
+/*
+ * Connects the given socket spark to its unix socket and adds the connection 
+ * to the kita state, without blocking. If the connection or the greeting can't
+ * be completed right away, kita will tell us when to carry on, see 
+ * feed_socket(). On failure, the time until the next attempt, as done by 
+ * reconnect_sparks(), will be increased. Returns 0 on success, -1 on error.
+ */
+static int connect_socket(state_s *state, thing_s *spark)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	socket_spec(spark, addr.sun_path, sizeof(addr.sun_path), NULL, 0);
+
+	spark->last_open = get_time();
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd == -1)
+	{
+		backoff_spark(spark);
+		return -1;
+	}
+
+	// a full backlog (EAGAIN) is retried later, like any other failure
+	int connected = connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0;
+	if (!connected && errno != EINPROGRESS)
+	{
+		close(fd);
+		backoff_spark(spark);
+		return -1;
+	}
+
+	// make_watch() closes the socket on error
+	spark->watch = make_watch(state, fd);
+	if (spark->watch == NULL)
+	{
+		backoff_spark(spark);
+		return -1;
+	}
+	spark->alive = 1;
+	spark->connecting = !connected;
+	spark->greeted = 0;
+
+	int pending = connected ? greet_socket(spark) : 1;
+	if (pending == -1 || (pending && kita_watch_set_feed(spark->watch, 1) == -1))
+	{
+		close_socket(spark);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Carries on with the given socket spark's connection once it is writable: 
+ * checks whether the connection has been established, if it was pending, and
+ * sends the rest of the greeting. Stops waiting for the connection to become 
+ * writable once done. Returns 0 on success, -1 if the connection failed.
+ */
+static int feed_socket(thing_s *spark)
+{
+	if (spark->connecting)
+	{
+		int error = 0;
+		socklen_t len = sizeof(error);
+		if (getsockopt(spark->watch->fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1 || error)
+		{
+			return -1;
+		}
+		spark->connecting = 0;
+	}
+
+	int pending = greet_socket(spark);
+	if (pending == -1)
+	{
+		return -1;
+	}
+	return pending ? 0 : kita_watch_set_feed(spark->watch, 0);
+}
+
+/*
+ * Reads everything available from the given thing's watch, appending it to 
+ * the thing's incomplete line, if any. Returns a malloc'd string with all 
+ * complete lines (without the final newline), keeping the remainder for later, 
+ * or NULL if there were no complete lines. If the other end has closed the 
+ * connection, `closed` will be set to 1.
+ */
+static char *read_watch_lines(thing_s *thing, int *closed)
+{
+	char buf[BUFFER_SOCKET];
+	size_t plen = thing->partial ? strlen(thing->partial) : 0;
+	ssize_t len;
+
+	while ((len = read(thing->watch->fd, buf, sizeof(buf))) > 0)
+	{
+		char *partial = realloc(thing->partial, plen + len + 1);
+		if (partial == NULL)
+		{
+			break;
+		}
+		memcpy(partial + plen, buf, len);
+		plen += len;
+		partial[plen] = '\0';
+		thing->partial = partial;
+	}
+	*closed = (len == 0 || (len == -1 && errno != EAGAIN && errno != EWOULDBLOCK));
+
+	// hand out all complete lines, keep the incomplete one
+	char *lines = NULL;
+	char *nl = thing->partial ? strrchr(thing->partial, '\n') : NULL;
+	if (nl)
+	{
+		*nl = '\0';
+		lines = thing->partial;
+		thing->partial = empty(nl + 1) ? NULL : strdup(nl + 1);
+	}
+
+	// a line this long is not what we're looking for, drop it
+	if (thing->partial && strlen(thing->partial) > BUFFER_SOCKET_MAX)
+	{
+		free(thing->partial);
+		thing->partial = NULL;
+	}
+
+	return lines;
+}
+
+/*
+ * Reads everything available from the given socket spark's connection and 
+ * feeds all complete lines to the spark's blocks, keeping the remainder for 
+ * later. Drops the connection if the other end has closed it.
+ * Returns 1 if lines have been fed to the blocks, otherwise 0.
+ */
+static int read_socket(state_s *state, thing_s *spark)
+{
+	int closed = 0;
+	char *lines = read_watch_lines(spark, &closed);
+	int fed = 0;
+
+	if (lines)
+	{
+		spark->last_read = get_time();
+		spark->backoff = 0.0;
+		fed = feed_spark(state, spark, lines);
+		free(lines);
+	}
+
+	if (closed)
+	{
+		fprintf(stderr, "read_socket(): lost connection to '%s'\n", spark->sid);
+		close_socket(spark);
+	}
+	return fed;
+}
+
+/*
+ * Watches the path of the given inotify spark again, after it has been lost 
+ * or couldn't be watched to begin with. As the file has most likely changed 
+ * in the meantime, the spark is fed a `create` event if it is interested in 
+ * those. On failure, the time until the next attempt, as done by 
+ * reconnect_sparks(), will be increased. Returns 0 on success, -1 on error.
+ */
+static int rewatch_inotify(state_s *state, thing_s *spark, double now)
+{
+	spark->last_open = now;
+	if (add_inotify(state, spark) == -1)
+	{
+		backoff_spark(spark);
+		return -1;
+	}
+	spark->backoff = 0.0;
+
+	if (spark->mask & IN_CREATE)
+	{
+		char line[] = "create";
+		spark->last_read = now;
+		feed_spark(state, spark, line);
+	}
+	return 0;
+}
+
+/*
+ * Attempts to reconnect all socket sparks that have lost their connection, 
+ * and to watch the paths of inotify sparks again that have lost their watch,
+ * provided that their backoff time has passed since their last attempt.
+ * Returns the number of sparks that have been reconnected.
+ */
+static size_t reconnect_sparks(state_s *state, double now)
+{
+	size_t num_reconnected = 0;
+	for (size_t i = 0; i < state->num_sparks; ++i)
+	{
+		thing_s *spark = &state->sparks[i];
+		if ((spark->s_type != SPARK_SOCKET && spark->s_type != SPARK_INOTIFY) || spark->alive)
+		{
+			continue;
+		}
+		if (now - spark->last_open + BLOCK_WAIT_TOLERANCE < spark->backoff)
+		{
+			continue;
+		}
+		if (spark->s_type == SPARK_SOCKET)
+		{
+			num_reconnected += (connect_socket(state, spark) == 0);
+		}
+		else
+		{
+			num_reconnected += (rewatch_inotify(state, spark, now) == 0);
+		}
+	}
+	return num_reconnected;
+}
+
+/*
+ * Creates (if needed) and opens the FIFO of the given push block and adds it 
+ * to the kita state. The FIFO is opened for reading and writing, so that it 
+ * doesn't hang up whenever the last writer is done. Missing parent directory 
+ * will be created, but only one level deep. Returns 0 on success, -1 on error.
+ */
+static int open_push(state_s *state, thing_s *block)
+{
+	const char *path = cfg_get_str(&block->cfg, BLOCK_OPT_PUSH);
+	if (empty(path))
+	{
+		return -1;
+	}
+
+	char dir[strlen(path) + 1];
+	strcpy(dir, path);
+	char *slash = strrchr(dir, '/');
+	if (slash && slash != dir)
+	{
+		*slash = '\0';
+		mkdir(dir, 0700);
+	}
+
+	if (mkfifo(path, 0600) == -1 && errno != EEXIST)
+	{
+		return -1;
+	}
+
+	struct stat st;
+	if (stat(path, &st) == -1 || !S_ISFIFO(st.st_mode))
+	{
+		return -1;
+	}
+
+	int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return -1;
+	}
+
+	block->watch = make_watch(state, fd);
+	block->last_open = get_time();
+	return block->watch ? 0 : -1;
+}
+
+/*
+ * Convenience function: opens the FIFOs of all push blocks.
+ * Returns the number of successfully opened FIFOs.
+ */
+static size_t open_pushes(state_s *state)
+{
+	size_t num_opened = 0;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		thing_s *block = &state->blocks[i];
+		if (block->b_type != BLOCK_PUSH)
+		{
+			continue;
+		}
+		if (open_push(state, block) == -1)
+		{
+			fprintf(stderr, "open_pushes(): failed to open FIFO for block '%s'\n", block->sid);
+			continue;
+		}
+		++num_opened;
+	}
+	return num_opened;
+}
+
+/*
+ * Reads all complete lines written to the push block's FIFO and makes the 
+ * last one the block's output. Returns 1 if the output has changed, else 0.
+ */
+static int read_push(state_s *state, thing_s *block)
+{
+	int closed = 0;
+	char *lines = read_watch_lines(block, &closed);
+	if (lines == NULL)
+	{
+		return 0;
+	}
+
+	char *last = strrchr(lines, '\n');
+	last = last ? last + 1 : lines;
+	block->last_read = get_time();
+	filter_output(block, last);
+
+	int same = (block->output && equals(block->output, last));
+	if (!same)
+	{
+		free(block->output);
+		block->output = strdup(last);
+		output_changed(state, block);
+		state->due = 1;
+	}
+	free(lines);
+	return !same;
+}
+
+/*
+ * Creates the eventfd watch via which plugin blocks report back and starts
+ * one worker thread per plugin block, up to PLUGIN_WORKERS. Does nothing if 
+ * there are no plugin blocks. Returns the number of workers, or -1 on error.
+ */
+static int open_plugins(state_s *state)
+{
+	size_t num_plugins = 0;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		num_plugins += (state->blocks[i].plugin != NULL);
+	}
+	if (num_plugins == 0)
+	{
+		return 0;
+	}
+
+	int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (efd == -1)
+	{
+		return -1;
+	}
+
+	state->plugins = make_watch(state, efd);
+	if (state->plugins == NULL)
+	{
+		return -1;
+	}
+
+	if (start_workers(efd, num_plugins) == 0)
+	{
+		free_watch(&state->plugins);
+		return -1;
+	}
+
+	// pick up output that plugins might have published during init()
+	notify_plugins();
+	return plugin_pool.num_threads;
+}
+
+/*
+ * Stops the worker threads and closes the eventfd watch.
+ */
+static void close_plugins(state_s *state)
+{
+	stop_workers();
+	free_watch(&state->plugins);
+}
+
+/*
+ * Collects the results of all plugin blocks, after the workers notified us 
+ * via the eventfd: updates the output of blocks that published new output
+ * and marks blocks whose poll() has returned as no longer running.
+ * Returns the number of blocks whose output has changed.
+ */
+static size_t read_plugins(state_s *state)
+{
+	uint64_t count = 0;
+	if (read(state->plugins->fd, &count, sizeof(count)) == -1)
+	{
+		return 0;
+	}
+
+	double now = get_time();
+	size_t changed = 0;
+	char buf[BUFFER_BLOCK_RESULT];
+	double next = 0.0;
+
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		thing_s *block = &state->blocks[i];
+		if (block->plugin == NULL)
+		{
+			continue;
+		}
+
+		int published = collect_plugin(block->plugin, buf, sizeof(buf), &next);
+		if (published)
+		{
+			filter_output(block, buf);
 		}
-
-		// Possibly add the block separator in front of the block
-		if (sep && same_align && i)
+		if (next >= 0.0)
 		{
-			strcat(bar_str, sep);
+			block->alive = 0;
+			block->last_read = now;
+			block->wake = (next > 0.0) ? now + next : 0.0;
+		}
+		if (published && !(block->output && equals(block->output, buf)))
+		{
+			free(block->output);
+			block->output = strdup(buf);
+			output_changed(state, block);
+			state->due = 1;
+			++changed;
 		}
-
-		// Add this block's result to the bar string
-		strcat(bar_str, block_str);
 	}
-
-	strcat(bar_str, "\n");
-	bar_str = realloc(bar_str, strlen(bar_str) + 1);
-	return bar_str;
+	return changed;
 }
 
 /*
- * Parses the format string for the bar, which should contain block names 
- * separated by whitespace and, optionally, up to two vertical bars to indicate 
- * alignment of blocks. For every block name found, the callback function `cb` 
- * will be run. Returns the number of block names found.
+ * Creates and starts the persistent shell, if there are any shell mode blocks.
+ * Returns 0 on success (or if there are no shell mode blocks), -1 on error.
  */
-static size_t parse_format(const char *format, create_block_callback cb, void *data)
+static int open_shell(state_s *state)
 {
-	if (format == NULL)
+	size_t num_blocks = 0;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		num_blocks += state->blocks[i].in_shell;
+	}
+	if (num_blocks == 0)
 	{
 		return 0;
 	}
 
-	size_t format_len = strlen(format) + 1;
-	char block_name[BUFFER_BLOCK_NAME];
-	block_name[0] = '\0';
-	size_t block_name_len = 0;
-	int block_align = -1;
-	int num_blocks = 0;
-
-	for (size_t i = 0; i < format_len; ++i)
+	shell_s *shell = malloc(sizeof(shell_s));
+	if (shell == NULL)
 	{
-		switch (format[i])
-		{
-		case '|':
-			// Next align
-			block_align += block_align < 1;
-			break;
-		case ' ':
-		case '\0':
-			if (block_name_len)
-			{
-				// Block name complete, inform the callback
-				cb(block_name, block_align, data);
-				// Prepare for the next block name
-				block_name[0] = '\0';
-				block_name_len = 0;
-			}
-			break;
-		default:
-			// Add the char to the current's block name
-			block_name[block_name_len++] = format[i];
-			block_name[block_name_len]   = '\0';
-		}
+		return -1;
 	}
+	*shell = (shell_s) { 0 };
 
-	// Return the number of blocks found
-	return num_blocks;
-}
+	// every block can be in the queue at most once, see run_shell()
+	shell->jobs = malloc(sizeof(shell_job_s) * num_blocks);
+	shell->size = num_blocks;
 
-static kita_child_s* make_child(state_s *state, const char *cmd, int in, int out, int err)
-{
-	// Create child process
-	kita_child_s *child = kita_child_new(cmd, in, out, err);
-	if (child == NULL)
+	const char *bin = cfg_get_str(&state->lemon.cfg, LEMON_OPT_SHELL);
+	shell->child = shell->jobs ? make_child(state, bin ? bin : DEFAULT_SHELL, 1, 1, 0) : NULL;
+	if (shell->child == NULL)
 	{
-		return NULL;
+		free_shell(shell);
+		return -1;
 	}
 
-	// Add the child to the kita 
-	if (kita_child_add(state->kita, child) == -1)
+	state->shell = shell;
+	if (spawn_shell(shell, get_time()) == -1)
 	{
-		kita_child_free(&child);
-		return NULL;
+		backoff_shell(shell);
+		return -1;
 	}
+	return 0;
+}
 
-	kita_child_set_context(child, state);
-	return child;
+static void close_shell(state_s *state)
+{
+	if (state->shell)
+	{
+		free_shell(state->shell);
+		state->shell = NULL;
+	}
 }
 
 /*
- * Finds and returns the block with the given `sid` -- or NULL.
+ * Reads the shell's responses: updates the output of the block whose command 
+ * has finished, then hands the next command to the shell, if any. 
+ * Returns 1 if the block's output has changed, otherwise 0.
  */
-static thing_s *get_block(const state_s *state, const char *sid)
+static int read_shell(state_s *state)
 {
-	// Iterate over all existing blocks and check for a name match
-	for (size_t i = 0; i < state->num_blocks; ++i)
+	shell_s *shell = state->shell;
+	char *lines = kita_child_read_lines(shell->child, KITA_IOS_OUT);
+	if (lines == NULL)
 	{
-		// If names match, return a pointer to this block
-		if (equals(state->blocks[i].sid, sid))
+		return 0;
+	}
+
+	double now = get_time();
+	int changed = 0;
+	char *line = lines;
+	while (*line)
+	{
+		size_t line_len = strcspn(line, "\n");
+		char *next = line + line_len + (line[line_len] == '\n');
+		line[line_len] = '\0';
+
+		const char *output = parse_shell(shell, line);
+		if (output)
 		{
-			return &state->blocks[i];
+			thing_s *block = shell->block;
+			shell->block = NULL;
+			shell->backoff = 0.0;
+
+			char buf[BUFFER_BLOCK_RESULT];
+			snprintf(buf, sizeof(buf), "%s", output);
+			filter_output(block, buf);
+			block->alive = 0;
+			block->last_read = now;
+
+			if (!(block->output && equals(block->output, buf)))
+			{
+				free(block->output);
+				block->output = strdup(buf);
+				output_changed(state, block);
+				state->due = 1;
+				changed = 1;
+			}
+			send_shell(shell, now);
 		}
+		line = next;
 	}
-	return NULL;
+	free(lines);
+	return changed;
 }
 
 /*
- * Add the block with the given SID to the collection of blocks, unless there 
- * is already a block with that SID present. 
- * Returns a pointer to the added (or existing) block or NULL in case of error.
+ * Opens the control socket, a unix datagram socket at the given path, through 
+ * which succade-msg (or any other program) can send commands at runtime. A 
+ * stale socket left at that path will be replaced. 
+ * Returns 0 on success, -1 on error.
  */
-static thing_s *add_block(state_s *state, const char *sid)
+static int open_control(state_s *state, const char *path)
 {
-	// See if there is an existing block by this name (and return, if so)
-	thing_s *eb = get_block(state, sid);
-	if (eb)
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(addr.sun_path))
 	{
-		return eb;
+		return -1;
 	}
+	strcpy(addr.sun_path, path);
 
-	// Resize the block container to be able to hold one more block
-	size_t current  =   state->num_blocks;
-	size_t new_size = ++state->num_blocks * sizeof(thing_s);
-	thing_s *blocks = realloc(state->blocks, new_size);
-	if (blocks == NULL)
+	int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1)
 	{
-		fprintf(stderr, "add_block(): realloc() failed!\n");
-		--state->num_blocks;
-		return NULL;
+		return -1;
 	}
-	state->blocks = blocks;
 
-	// Create the block, setting its name and default values
-	state->blocks[current] = (thing_s) { 0 };
-	state->blocks[current].sid    = strdup(sid);
-	state->blocks[current].t_type = THING_BLOCK;
-	state->blocks[current].b_type = BLOCK_ONCE;
-	cfg_init(&state->blocks[current].cfg, "default", BLOCK_OPT_COUNT);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+	{
+		close(fd);
+		return -1;
+	}
 
-	// Return a pointer to the new block
-	return &state->blocks[current];
+	state->control = make_watch(state, fd);
+	if (state->control == NULL)
+	{
+		unlink(path);
+		return -1;
+	}
+
+	state->control_path = strdup(path);
+	return 0;
 }
 
 /*
- * inih doc: "Handler should return nonzero on success, zero on error."
+ * Closes the control socket, if open, and removes it from the file system.
  */
-int lemon_cfg_handler(void *data, const char *section, const char *name, const char *value)
+static void close_control(state_s *state)
 {
-	state_s *state = (state_s*) data;
+	free_watch(&state->control);
+	if (state->control_path)
+	{
+		unlink(state->control_path);
+		free(state->control_path);
+		state->control_path = NULL;
+	}
+}
 
-	// Only process if section is empty or specificially for bar
-	if (empty(section) || equals(section, state->lemon.sid))
+/*
+ * Returns the name of the given block's type, as used in status replies.
+ */
+static const char *block_type_name(const thing_s *block)
+{
+	switch (block->b_type)
 	{
-		return lemon_ini_handler(&state->lemon, section, name, value);
+		case BLOCK_ONCE:    return "once";
+		case BLOCK_TIMED:   return "timed";
+		case BLOCK_SPARKED: return "sparked";
+		case BLOCK_LIVE:    return "live";
+		case BLOCK_PUSH:    return "push";
+		case BLOCK_SOURCED: return "sourced";
+		default:            return "none";
 	}
+}
 
-	return 1;
+/*
+ * Writes one line per block to `reply`, holding the block's name, type, state 
+ * and current output. Returns the number of characters written to `reply`.
+ */
+static size_t control_status(const state_s *state, char *reply, size_t len)
+{
+	size_t pos = 0;
+	for (size_t i = 0; i < state->num_blocks && pos < len; ++i)
+	{
+		const thing_s *block = &state->blocks[i];
+		const char *status = block->paused ? "paused" : 
+			(block->alive || block->watch) ? "running" : "idle";
+
+		int n = snprintf(reply + pos, len - pos, "%s %s %s %s\n", block->sid, 
+				block_type_name(block), status, strsel(block->output, "", ""));
+		pos += (n > 0) ? (size_t) n : 0;
+	}
+	return pos < len ? pos : len - 1;
 }
 
 /*
- * inih doc: "Handler should return nonzero on success, zero on error."
+ * Executes the given control command, which has the format `verb [block [arg]]`,
+ * and writes the reply, `ok` or an error message, to `reply`. If no block is 
+ * given for `refresh`, `pause` or `resume`, the command applies to all blocks. 
+ * Commands for blocks that share a process with another block are applied to 
+ * that block instead. Note that `cmd` will be modified. 
+ * Returns 0 on success, -1 on error.
  */
-int block_cfg_handler(void *data, const char *section, const char *name, const char *value)
+static int run_control(state_s *state, char *cmd, char *reply, size_t len)
 {
-	state_s *state = (state_s*) data;
+	cmd[strcspn(cmd, "\n")] = '\0';
 
-	// Abort if section is empty or specifically for bar
-	if (empty(section) || (equals(section, state->lemon.sid)))
+	char *verb = cmd;
+	char *name = split_word(verb);
+	char *arg  = split_word(name);
+
+	if (equals(verb, "status"))
 	{
-		return 1;
+		control_status(state, reply, len);
+		return 0;
 	}
 
-	// Find the block whose name fits the section name
-	thing_s *block = equals(section, ALBEDO_SID) ? &state->albedo : get_block(state, section);
+	int multi = equals(verb, "refresh") || equals(verb, "pause") || equals(verb, "resume");
+	if (!multi && !equals(verb, "interval") && !equals(verb, "set"))
+	{
+		snprintf(reply, len, "error: unknown command '%.64s'\n", verb);
+		return -1;
+	}
 
-	// Abort if we couldn't find that block
-	if (block == NULL)
+	int all = multi && empty(name);
+
+	thing_s *block = empty(name) ? NULL : get_block(state, name);
+	if (block == NULL && !all)
 	{
-		return 1;
+		snprintf(reply, len, "error: unknown block '%.64s'\n", name);
+		return -1;
 	}
 
-	// Process via the appropriate handler
-	return block_ini_handler(block, section, name, value);
+	if (equals(verb, "set"))
+	{
+		free(block->output);
+		block->output = strdup(arg);
+		share_output(state, block);
+		output_changed(state, block);
+		state->due = 1;
+		snprintf(reply, len, "ok\n");
+		return 0;
+	}
+
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		thing_s *target = all ? &state->blocks[i] : block;
+		target = target->host ? target->host : target;
+
+		if (equals(verb, "refresh"))
+		{
+			target->due = 1;
+		}
+		else if (equals(verb, "pause"))
+		{
+			target->paused = 1;
+		}
+		else if (equals(verb, "resume"))
+		{
+			target->paused = 0;
+		}
+		else // interval
+		{
+			if (target->b_type != BLOCK_ONCE && target->b_type != BLOCK_TIMED)
+			{
+				snprintf(reply, len, "error: block '%.64s' is not timed\n", name);
+				return -1;
+			}
+			if (atof(arg) <= 0.0)
+			{
+				snprintf(reply, len, "error: invalid interval '%.64s'\n", arg);
+				return -1;
+			}
+			target->b_type = BLOCK_TIMED;
+			cfg_set_float(&target->cfg, BLOCK_OPT_RELOAD, atof(arg));
+		}
+
+		if (!all)
+		{
+			break;
+		}
+	}
+
+	snprintf(reply, len, "ok\n");
+	return 0;
 }
 
 /*
- * Load the config and parse the section for the bar, ignoring other sections.
- * Returns 0 on success, -1 on file open error, -2 on memory allocation error, 
- * -3 if no config file path was given in the preferences, or the line number 
- * of the first encountered parse error.
+ * Reads all pending commands from the control socket, runs them and sends the
+ * reply back to the sender, if it can receive one (that is, if it is bound).
+ * Returns the number of commands processed.
  */
-static int load_lemon_cfg(state_s *state)
+static size_t read_control(state_s *state)
 {
-	// Abort if config file path empty or NULL
-	if (empty(state->prefs.config))
+	char cmd[BUFFER_CONTROL];
+	char reply[BUFFER_CONTROL];
+	struct sockaddr_un from;
+	socklen_t from_len = sizeof(from);
+	size_t num_cmds = 0;
+	ssize_t len;
+
+	while ((len = recvfrom(state->control->fd, cmd, sizeof(cmd) - 1, 0, 
+					(struct sockaddr *) &from, &from_len)) >= 0)
 	{
-		return -3;
-	}
+		cmd[len] = '\0';
+		reply[0] = '\0';
+		run_control(state, cmd, reply, sizeof(reply));
 
-	// Fire up the INI parser
-	return ini_parse(state->prefs.config, lemon_cfg_handler, state);
+		if (from_len > sizeof(sa_family_t))
+		{
+			sendto(state->control->fd, reply, strlen(reply), MSG_DONTWAIT, 
+					(struct sockaddr *) &from, from_len);
+		}
+
+		from_len = sizeof(from);
+		++num_cmds;
+	}
+	return num_cmds;
 }
 
 /*
- * Load the config and parse all sections apart from the bar section.
- * Returns 0 on success, -1 on file open error, -2 on memory allocation error, 
- * -3 if no config file path was given in the preferences, or the line number 
- * of the first encountered parse error.
+ * Returns the block whose output triggers the given block, if the block has 
+ * a trigger of the form `block:name`, otherwise NULL.
  */
-static int load_block_cfg(state_s *state)
+static thing_s *trigger_block(const thing_s *block)
 {
-	// Abort if config file path empty or NULL
-	if (empty(state->prefs.config))
+	if (block->b_type != BLOCK_SPARKED || block->other == NULL)
 	{
-		return -3;
+		return NULL;
 	}
-
-	return ini_parse(state->prefs.config, block_cfg_handler, state);
+	return block->other->s_type == SPARK_BLOCK ? block->other->other : NULL;
 }
 
-static thing_s *get_spark(state_s *state, void *block, const char *cmd)
+/*
+ * Creates one spark per distinct trigger command, then subscribes all sparked 
+ * blocks to the spark for their trigger, by pointing their `other` to it. 
+ * Returns the number of sparks created.
+ */
+static size_t create_sparks(state_s *state)
 {
-	for (size_t i = 0; i < state->num_sparks; ++i)
+	thing_s *block = NULL;
+	for (size_t i = 0; i < state->num_blocks; ++i)
 	{
-		if (state->sparks[i].other != block)
+		block = &state->blocks[i];
+
+		if (block->b_type != BLOCK_SPARKED || block->host)
 		{
 			continue;
 		}
-		if (!equals(state->sparks[i].child->cmd, cmd))
+
+		char *trigger = cfg_get_str(&block->cfg, BLOCK_OPT_TRIGGER);
+		if (empty(trigger))
 		{
+			fprintf(stderr, "create_sparks(): missing trigger for sparked block '%s'\n", block->sid);
 			continue;
 		}
-		return &state->sparks[i];
-	}
-	return NULL;
-}
 
-static thing_s *add_spark(state_s *state, thing_s *block, const char *cmd)
-{
-	// See if there is an existing spark that matches the given params
-	thing_s *es = get_spark(state, block, cmd);
-	if (es)
-	{
-		return es;
+		add_spark(state, trigger);
 	}
 
-	// Resize the spark array to be able to hold one more spark
-	size_t current  =   state->num_sparks;
-	size_t new_size = ++state->num_sparks * sizeof(thing_s);
-	thing_s *sparks = realloc(state->sparks, new_size);
-	if (sparks == NULL)
+	for (size_t i = 0; i < state->num_sparks; ++i)
 	{
-		fprintf(stderr, "add_spark(): realloc() failed!\n");
-		--state->num_sparks;
-		return NULL;
+		thing_s *spark = &state->sparks[i];
+		switch (spark->s_type)
+		{
+			case SPARK_CHILD:
+				spark->child = make_child(state, spark->sid, 0, 1, 0);
+				break;
+			case SPARK_INOTIFY:
+				if (add_inotify(state, spark) == -1)
+				{
+					fprintf(stderr, "create_sparks(): failed to watch '%s'\n", spark->sid);
+				}
+				break;
+			case SPARK_UEVENT:
+				if (add_uevent(state, spark) == -1)
+				{
+					fprintf(stderr, "create_sparks(): failed to listen for '%s'\n", spark->sid);
+				}
+				break;
+			case SPARK_NETLINK:
+				if (add_netlink(state, spark) == -1)
+				{
+					fprintf(stderr, "create_sparks(): failed to listen for '%s'\n", spark->sid);
+				}
+				break;
+			case SPARK_SOCKET:
+				if (connect_socket(state, spark) == -1)
+				{
+					fprintf(stderr, "create_sparks(): failed to connect to '%s', will retry\n", spark->sid);
+				}
+				break;
+			case SPARK_BLOCK:
+				spark->other = get_block(state, spark->sid + strlen(SPARK_PREFIX_BLOCK));
+				spark->alive = (spark->other != NULL);
+				if (spark->other == NULL)
+				{
+					fprintf(stderr, "create_sparks(): no such block for '%s'\n", spark->sid);
+				}
+				break;
+		}
 	}
-	state->sparks = sparks; 
-	 
-	state->sparks[current] = (thing_s) { 0 };
-	state->sparks[current].t_type = THING_SPARK;
-	state->sparks[current].other  = block;
-
-	// Add a reference of this spark to the block we've created it for
-	block->other = &state->sparks[current];
-
-	// Return a pointer to the new spark
-	return &state->sparks[current];
-}
 
-static size_t create_sparks(state_s *state)
-{
-	thing_s *block = NULL;
+	// Only link blocks now, as add_spark() might have moved the sparks
 	for (size_t i = 0; i < state->num_blocks; ++i)
 	{
 		block = &state->blocks[i];
 
-		if (block->b_type != BLOCK_SPARKED)
+		if (block->b_type != BLOCK_SPARKED || block->host)
 		{
 			continue;
 		}
 
 		char *trigger = cfg_get_str(&block->cfg, BLOCK_OPT_TRIGGER);
-		if (empty(trigger))
-		{
-			fprintf(stderr, "create_sparks(): missing trigger for sparked block '%s'\n", block->sid);
-			continue;
-		}
-
-		add_spark(state, block, trigger);
+		block->other = empty(trigger) ? NULL : get_spark(state, trigger);
 	}
 
-	for (size_t i = 0; i < state->num_sparks; ++i)
+	// Blocks triggering each other in a circle would never come to rest
+	for (size_t i = 0; i < state->num_blocks; ++i)
 	{
-		char *trigger = cfg_get_str(&state->sparks[i].other->cfg, BLOCK_OPT_TRIGGER);
-		state->sparks[i].child = make_child(state, trigger, 0, 1, 0);
+		block = &state->blocks[i];
+
+		thing_s *prev = block;
+		for (size_t n = 0; n < state->num_blocks && prev; ++n)
+		{
+			prev = trigger_block(prev);
+			if (prev == block)
+			{
+				fprintf(stderr, "create_sparks(): block '%s' indirectly triggers itself, ignoring its trigger\n", block->sid);
+				block->other = NULL;
+				break;
+			}
+		}
 	}
 
 	return state->num_sparks;
@@ -899,6 +3771,24 @@ int run_cmd(const char *cmd)
 	return 0;
 }
 
+/*
+ * Handles a click on the given block: runs the command configured for the 
+ * mouse button `opt`, if any, otherwise hands the click to the block's plugin.
+ * Returns 0 on success, -1 on error.
+ */
+static int click_block(thing_s *block, int button, int opt)
+{
+	if (cfg_has(&block->cfg, opt))
+	{
+		return run_cmd(cfg_get_str(&block->cfg, opt));
+	}
+	if (block->plugin)
+	{
+		return queue_plugin(block->plugin, NULL, button);
+	}
+	return -1;
+}
+
 /*
  * Takes a string that might represent an action that was registered with one 
  * of the blocks and tries to find the associated block. If found, the command
@@ -936,23 +3826,23 @@ static int process_action(const state_s *state, const char *action)
 	// Now to fire the right command for the action type
 	if (equals(type, "_lmb"))
 	{
-		return run_cmd(cfg_get_str(&source->cfg, BLOCK_OPT_CMD_LMB));
+		return click_block(source, 1, BLOCK_OPT_CMD_LMB);
 	}
 	if (equals(type, "_mmb"))
 	{
-		return run_cmd(cfg_get_str(&source->cfg, BLOCK_OPT_CMD_MMB));
+		return click_block(source, 2, BLOCK_OPT_CMD_MMB);
 	}
 	if (equals(type, "_rmb"))
 	{
-		return run_cmd(cfg_get_str(&source->cfg, BLOCK_OPT_CMD_RMB));
+		return click_block(source, 3, BLOCK_OPT_CMD_RMB);
 	}
 	if (equals(type, "_sup"))
 	{
-		return run_cmd(cfg_get_str(&source->cfg, BLOCK_OPT_CMD_SUP));
+		return click_block(source, 4, BLOCK_OPT_CMD_SUP);
 	}
 	if (equals(type, "_sdn"))
 	{
-		return run_cmd(cfg_get_str(&source->cfg, BLOCK_OPT_CMD_SDN));
+		return click_block(source, 5, BLOCK_OPT_CMD_SDN);
 	}
 
 	// Invalid action type (how in the world did that happen?)
@@ -1054,6 +3944,16 @@ void on_child_readok(kita_state_s *ks, kita_event_s *ke)
 	}
 
 	state_s *state = (state_s*) kita_child_get_context(ke->child);
+
+	if (state->shell && ke->child == state->shell->child)
+	{
+		if (ke->ios == KITA_IOS_OUT)
+		{
+			read_shell(state);
+		}
+		return;
+	}
+
 	thing_s *thing = thing_by_child(state, ke->child);
 
 	if (thing == NULL)
@@ -1086,10 +3986,23 @@ void on_child_readok(kita_state_s *ks, kita_event_s *ke)
 		{
 			// schedule an update if the block's output was
 			// different from its previous output
-			if (read_block(thing))
+			if (cfg_get_int(&thing->cfg, BLOCK_OPT_MULTIPLEX))
+			{
+				demux_block(state, thing);
+			}
+			else if (read_block(thing))
 			{
+				share_output(state, thing);
+				output_changed(state, thing);
 				state->due = 1;
 			}
+
+			// persistent blocks are done once they have responded
+			if (thing->persistent)
+			{
+				thing->alive = 0;
+				thing->backoff = 0.0;
+			}
 		}
 		else
 		{
@@ -1103,7 +4016,7 @@ void on_child_readok(kita_state_s *ks, kita_event_s *ke)
 	{
 		if (ke->ios == KITA_IOS_OUT)
 		{
-			read_spark(thing);
+			read_spark(state, thing);
 		}
 		return;
 	}
@@ -1148,11 +4061,182 @@ void on_child_exited(kita_state_s *ks, kita_event_s *ke)
 void on_child_reaped(kita_state_s *ks, kita_event_s *ke)
 {
 	//fprintf(stderr, "on_child_reaped(): %s\n", ke->child->cmd);
+
+	state_s *state = (state_s*) kita_child_get_context(ke->child);
+	if (state->shell && ke->child == state->shell->child)
+	{
+		reap_shell(state->shell);
+		return;
+	}
+
+	// persistent blocks get their process restarted after a while, unless 
+	// we are shutting down, which is when all children get reaped anyway
+	thing_s *thing = thing_by_child(state, ke->child);
+	if (thing && thing->persistent && running)
+	{
+		backoff_persistent(thing, get_time());
+	}
+
 	on_child_exited(ks, ke);
 }
 
+void on_watch_readok(kita_state_s *ks, kita_event_s *ke)
+{
+	state_s *state = (state_s*) kita_watch_get_context(ke->watch);
+
+	if (ke->watch == state->clock)
+	{
+		read_clock(state);
+		return;
+	}
+
+	if (ke->watch == state->signals)
+	{
+		read_signals(state);
+		return;
+	}
+
+	if (ke->watch == state->inotify)
+	{
+		read_inotify(state);
+		return;
+	}
+
+	if (ke->watch == state->uevent)
+	{
+		read_uevent(state);
+		return;
+	}
+
+	if (ke->watch == state->netlink)
+	{
+		read_netlink(state);
+		return;
+	}
+
+	if (ke->watch == state->plugins)
+	{
+		read_plugins(state);
+		return;
+	}
+
+	if (ke->watch == state->control)
+	{
+		read_control(state);
+		return;
+	}
+
+	if (ke->watch == state->events)
+	{
+		accept_subs(state);
+		return;
+	}
+
+	for (size_t i = 0; i < state->num_subs; ++i)
+	{
+		if (ke->watch == state->subs[i].watch)
+		{
+			read_sub(state, i);
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < state->num_sparks; ++i)
+	{
+		if (ke->watch == state->sparks[i].watch)
+		{
+			read_socket(state, &state->sparks[i]);
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		if (ke->watch == state->blocks[i].watch)
+		{
+			read_push(state, &state->blocks[i]);
+			return;
+		}
+	}
+}
+
+void on_watch_feedok(kita_state_s *ks, kita_event_s *ke)
+{
+	state_s *state = (state_s*) kita_watch_get_context(ke->watch);
+
+	for (size_t i = 0; i < state->num_subs; ++i)
+	{
+		if (ke->watch == state->subs[i].watch)
+		{
+			if (flush_sub(&state->subs[i]) == -1)
+			{
+				drop_sub(state, i);
+			}
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < state->num_sparks; ++i)
+	{
+		if (ke->watch == state->sparks[i].watch)
+		{
+			if (feed_socket(&state->sparks[i]) == -1)
+			{
+				fprintf(stderr, "on_watch_feedok(): could not connect to '%s'\n", state->sparks[i].sid);
+				close_socket(&state->sparks[i]);
+			}
+			return;
+		}
+	}
+}
+
+void on_watch_hangup(kita_state_s *ks, kita_event_s *ke)
+{
+	state_s *state = (state_s*) kita_watch_get_context(ke->watch);
+
+	for (size_t i = 0; i < state->num_subs; ++i)
+	{
+		if (ke->watch == state->subs[i].watch)
+		{
+			drop_sub(state, i);
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < state->num_sparks; ++i)
+	{
+		if (ke->watch == state->sparks[i].watch)
+		{
+			fprintf(stderr, "on_watch_hangup(): lost connection to '%s'\n", state->sparks[i].sid);
+			close_socket(&state->sparks[i]);
+			return;
+		}
+	}
+}
+
 static void cleanup(state_s *state)
 {
+	// free watches (clock, signals, native sparks)
+	free_watch(&state->clock);
+	free_watch(&state->signals);
+	free_watch(&state->inotify);
+	free_watch(&state->uevent);
+	free_watch(&state->netlink);
+	close_plugins(state);
+	close_shell(state);
+	close_control(state);
+	close_events(state);
+	close_status(state);
+	close_samplers();
+	for (size_t i = 0; i < state->num_sparks; ++i)
+	{
+		free_watch(&state->sparks[i].watch);
+	}
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		free_watch(&state->blocks[i].watch);
+	}
+
 	// free sparks
 	free_sparks(state);
 	free(state->sparks);
@@ -1244,6 +4328,7 @@ int main(int argc, char **argv)
 
 	kita_state_s *kita = state.kita; // For convenience
 	kita_set_option(kita, KITA_OPT_NO_NEWLINE, 1);
+	kita_set_option(kita, KITA_OPT_LAST_LINE, 1);
 
 	// 
 	// KITA CALLBACKS 
@@ -1255,6 +4340,9 @@ int main(int argc, char **argv)
 	kita_set_callback(kita, KITA_EVT_CHILD_EXITED, on_child_exited);
 	kita_set_callback(kita, KITA_EVT_CHILD_READOK, on_child_readok);
 	kita_set_callback(kita, KITA_EVT_CHILD_ERROR,  on_child_error);
+	kita_set_callback(kita, KITA_EVT_WATCH_READOK, on_watch_readok);
+	kita_set_callback(kita, KITA_EVT_WATCH_FEEDOK, on_watch_feedok);
+	kita_set_callback(kita, KITA_EVT_WATCH_HANGUP, on_watch_hangup);
 
 	//
 	// COMMAND LINE ARGUMENTS
@@ -1334,9 +4422,14 @@ int main(int argc, char **argv)
 		cfg_set_int(&lemon->cfg, LEMON_OPT_AREAS, 0);
 	}
 
-	// create the child process and add it to the kita state
+	// create the child process and add it to the kita state; the options
+	// are part of the command, as a child's argument string would be passed
+	// on as a single argument
 	char *lemon_bin = cfg_get_str(&lemon->cfg, LEMON_OPT_BIN);
-	lemon->child = make_child(&state, lemon_bin, 1, 1, 1);
+	char lemon_cmd[strlen(lemon_bin) + BUFFER_LEMON_ARG + 1];
+	int lemon_len = snprintf(lemon_cmd, sizeof(lemon_cmd), "%s ", lemon_bin);
+	lemon_arg(lemon, lemon_cmd + lemon_len, sizeof(lemon_cmd) - lemon_len);
+	lemon->child = make_child(&state, lemon_cmd, 1, 1, 1);
 	if (lemon->child == NULL)
 	{
 		fprintf(stderr, "Failed to create bar process: %s\n", lemon_bin);
@@ -1390,9 +4483,6 @@ int main(int argc, char **argv)
 	for (size_t i = 0; i < state.num_blocks; ++i)
 	{
 		block = &state.blocks[i];
-		char *block_bin = cfg_get_str(&block->cfg, BLOCK_OPT_BIN);
-		char *block_cmd = block_bin ? block_bin : block->sid;
-		block->child = make_child(&state, block_cmd, 0, 1, 1);
 
 		// merge albedo (default config) with this block's config
 		for (int i = 0; i < BLOCK_OPT_COUNT; ++i)
@@ -1415,6 +4505,98 @@ int main(int argc, char **argv)
 				}
 			}
 		}
+
+		char *block_bin = cfg_get_str(&block->cfg, BLOCK_OPT_BIN);
+		char *block_cmd = block_bin ? block_bin : block->sid;
+
+		// script blocks are run by succade itself, without a child
+		const char *script = cfg_get_str(&block->cfg, BLOCK_OPT_SCRIPT);
+		if (script)
+		{
+			if (init_script(&state, block, script) == -1)
+			{
+				fprintf(stderr, "Failed to set up script block: %s\n", block->sid);
+				block->b_type = BLOCK_NONE;
+			}
+			continue;
+		}
+
+		// built-in blocks are run by succade itself, without a child
+		if (has_prefix(block_cmd, BUILTIN_PREFIX))
+		{
+			if (init_builtin(block, block_cmd + strlen(BUILTIN_PREFIX)) == -1)
+			{
+				fprintf(stderr, "Failed to set up built-in block: %s\n", block->sid);
+				block->b_type = BLOCK_NONE;
+			}
+			continue;
+		}
+
+		// plugin blocks are run by our worker threads, without a child
+		if (has_prefix(block_cmd, PLUGIN_PREFIX))
+		{
+			if (load_plugin(block, block_cmd + strlen(PLUGIN_PREFIX)) == -1)
+			{
+				fprintf(stderr, "Failed to load plugin for block: %s\n", block->sid);
+				block->b_type = BLOCK_NONE;
+			}
+			continue;
+		}
+
+		// shell mode blocks are run by the persistent shell, without a child
+		if (cfg_get_int(&block->cfg, BLOCK_OPT_SHELL))
+		{
+			if (block->b_type == BLOCK_LIVE || cfg_get_int(&block->cfg, BLOCK_OPT_MULTIPLEX))
+			{
+				fprintf(stderr, "Live and multiplexed blocks can't use shell mode: %s\n", block->sid);
+			}
+			else if (block->b_type != BLOCK_PUSH && block->b_type != BLOCK_SOURCED)
+			{
+				block->in_shell = 1;
+				continue;
+			}
+		}
+
+		// persistent blocks need something to send requests for
+		if (cfg_get_int(&block->cfg, BLOCK_OPT_PERSISTENT) &&
+		    block->b_type != BLOCK_TIMED && block->b_type != BLOCK_SPARKED)
+		{
+			fprintf(stderr, "Only timed and triggered blocks can be persistent: %s\n", block->sid);
+			cfg_set_int(&block->cfg, BLOCK_OPT_PERSISTENT, 0);
+		}
+
+		// share the child of an identical block, if there is one
+		block->host = get_host(&state, block, block_cmd);
+		if (block->host == NULL && block->b_type != BLOCK_PUSH && block->b_type != BLOCK_SOURCED)
+		{
+			block->persistent = cfg_get_int(&block->cfg, BLOCK_OPT_PERSISTENT);
+			block->child = make_child(&state, block_cmd, block->persistent, 1, 1);
+		}
+	}
+
+	// link sourced blocks to their multiplexed source blocks
+	link_sources(&state);
+
+	// set up run conditions, output filters and formatters, now that all 
+	// blocks and their configs exist
+	for (size_t i = 0; i < state.num_blocks; ++i)
+	{
+		if (init_cond(&state, &state.blocks[i]) == -1)
+		{
+			fprintf(stderr, "Failed to set up run conditions for block: %s\n", state.blocks[i].sid);
+			state.blocks[i].b_type = BLOCK_NONE;
+			continue;
+		}
+		if (init_filter(&state.blocks[i]) == -1)
+		{
+			fprintf(stderr, "Failed to set up output filter for block: %s\n", state.blocks[i].sid);
+			state.blocks[i].b_type = BLOCK_NONE;
+			continue;
+		}
+		if (init_fmt(&state.blocks[i]) == -1)
+		{
+			fprintf(stderr, "Failed to set up output formatter for block: %s\n", state.blocks[i].sid);
+		}
 	}
 
 	//
@@ -1423,7 +4605,87 @@ int main(int argc, char **argv)
 
 	create_sparks(&state);
 	open_sparks(&state);
+
+	//
+	// PUSH BLOCKS
+	//
+
+	open_pushes(&state);
+
+	//
+	// PLUGINS
+	//
+
+	if (open_plugins(&state) == -1)
+	{
+		fprintf(stderr, "Failed to start worker threads, plugin blocks won't run\n");
+	}
+
+	//
+	// SHELL
+	//
+
+	// if this fails, check_shell() will keep trying to start it
+	if (open_shell(&state) == -1)
+	{
+		fprintf(stderr, "Failed to start shell for shell mode blocks\n");
+	}
+
+	//
+	// CLOCK
+	//
+
+	// get notified of clock jumps and resume from suspend (optional)
+	if (open_clock(&state) == -1)
+	{
+		fprintf(stderr, "Failed to create clock watch, clock jumps will go unnoticed\n");
+	}
+	state.slept = get_slept();
+
+	//
+	// SIGNALS
+	//
+
+	// run blocks on demand when they receive their real-time signal
+	if (open_signals(&state) == -1)
+	{
+		fprintf(stderr, "Failed to create signal watch, block signals will be ignored\n");
+	}
 	
+	//
+	// IPC (CONTROL SOCKET, EVENTS SOCKET, STATUS PAGE)
+	//
+
+	// accept commands at runtime, see succade-msg
+	char control_name[BUFFER_BLOCK_NAME + sizeof(CONTROL_SOCKET_NAME)];
+	snprintf(control_name, sizeof(control_name), CONTROL_SOCKET_NAME, prefs->section);
+	char *control_path = runtime_path(control_name);
+	if (control_path == NULL || open_control(&state, control_path) == -1)
+	{
+		fprintf(stderr, "Failed to open control socket: %s\n", strsel(control_path, "no safe runtime directory", ""));
+	}
+	free(control_path);
+
+	// stream output changes to subscribers
+	char events_name[BUFFER_BLOCK_NAME + sizeof(EVENTS_SOCKET_NAME)];
+	snprintf(events_name, sizeof(events_name), EVENTS_SOCKET_NAME, prefs->section);
+	char *events_path = runtime_path(events_name);
+	if (events_path == NULL || open_events(&state, events_path) == -1)
+	{
+		fprintf(stderr, "Failed to open events socket: %s\n", strsel(events_path, "no safe runtime directory", ""));
+	}
+	free(events_path);
+
+	// let other programs read block outputs from shared memory
+	char status_name[BUFFER_BLOCK_NAME + sizeof(STATUS_PAGE_NAME)];
+	snprintf(status_name, sizeof(status_name), STATUS_PAGE_NAME, prefs->section);
+	char *status_path = runtime_path(status_name);
+	if (status_path == NULL || open_status(&state, status_path) == -1)
+	{
+		fprintf(stderr, "Failed to create status page: %s\n", strsel(status_path, "no safe runtime directory", ""));
+	}
+	free(status_path);
+
 	//
 	// MAIN LOOP
 	//
@@ -1439,6 +4701,18 @@ int main(int argc, char **argv)
 	{
 		// update time (passed)
 		now    = get_time();
+
+		// refresh timed blocks if we have been suspended in the meantime
+		check_suspend(&state);
+
+		// reconnect socket triggers that have lost their connection
+		reconnect_sparks(&state, now);
+
+		// restart the shell if it died, or kill it if it hangs
+		check_shell(state.shell, now);
+
+		// kill persistent blocks that stopped responding, to restart them
+		check_persistent(&state, now);
 		//delta  = now - before;
 		//before = now;
 
@@ -1450,11 +4724,11 @@ int main(int argc, char **argv)
 		// feed lemon (if the state's 'due' field is set)
 		feed_lemon(&state);
 
-		// let kita check for child events (for up to `wait` seconds)
-		kita_tick(kita, (wait == -1 ? wait : wait * MILLISEC_PER_SEC));
-
 		// figure out how long we can idle, based on timed blocks
 		wait = time_to_wait(&state, now);
+
+		// let kita check for child events (for up to `wait` seconds)
+		kita_tick(kita, (wait == -1 ? wait : wait * MILLISEC_PER_SEC));
 	}
 
 	//
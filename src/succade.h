@@ -2,7 +2,13 @@
 #define SUCCADE_H
 
 #include "libkita.h"
-#include <unistd.h> // STDOUT_FILENO, STDIN_FILENO, STDERR_FILENO
+#include <unistd.h>    // STDOUT_FILENO, STDIN_FILENO, STDERR_FILENO
+#include <regex.h>     // regex_t
+#include <sys/stat.h>  // struct stat
+#include <stdint.h>    // uint32_t, uint64_t
+#include <stdatomic.h> // atomic_uint
+#include <pthread.h>   // pthread_mutex_t
+#include "succade-plugin.h" // struct succade_plugin
 
 #define DEBUG 0
 
@@ -20,6 +26,8 @@
 #define BUFFER_BLOCK_STR     2048
 
 #define BLOCK_WAIT_TOLERANCE 0.1
+#define BLOCK_REAP_WAIT      0.01
+#define SUSPEND_TOLERANCE    1.0
 #define MILLISEC_PER_SEC     1000
 
 #define DEFAULT_CFG_FILE "succaderc"
@@ -30,6 +38,49 @@
 #define DEFAULT_LEMON_NAME    "succade_lemonbar"
 #define DEFAULT_LEMON_SECTION "bar"
 
+#define SPARK_PREFIX_INOTIFY  "inotify:"
+#define SPARK_PREFIX_UEVENT   "uevent:"
+#define SPARK_PREFIX_NETLINK  "netlink:"
+#define SPARK_PREFIX_SOCKET   "socket:"
+#define SPARK_PREFIX_BLOCK    "block:"
+#define BUILTIN_PREFIX        "builtin:"
+#define PLUGIN_PREFIX         "plugin:"
+#define BUFFER_INOTIFY       4096
+#define BUFFER_NETLINK       8192
+#define BUFFER_SOCKET        4096
+#define BUFFER_SOCKET_MAX   65536
+
+#define CONTROL_SOCKET_NAME  "succade-%s.sock"
+#define BUFFER_CONTROL       8192
+#define EVENTS_SOCKET_NAME   "succade-%s-events.sock"
+#define STATUS_PAGE_NAME     "succade-%s.status"
+#define STATUS_PAGE_MAGIC    0x73636164 // "scad"
+#define STATUS_PAGE_VERSION  1
+#define BUFFER_SUBSCRIBER   16384
+
+#define SPARK_BACKOFF_MIN    1.0
+#define SPARK_BACKOFF_MAX   60.0
+
+#define FORMAT_BAR_FULL       '='
+#define FORMAT_BAR_EMPTY      '-'
+
+#define BUFFER_SCRIPT_READ   4096
+#define SCRIPT_BUDGET     1000000
+#define SCRIPT_MEMORY    16777216
+
+#define PLUGIN_WORKERS          4
+#define PLUGIN_QUEUE           64
+
+#define DEFAULT_SHELL   "/bin/sh"
+#define SHELL_TIMEOUT         5.0
+#define SHELL_BACKOFF_MIN     1.0
+#define SHELL_BACKOFF_MAX    60.0
+#define BUFFER_SHELL_TOKEN     48
+
+#define PERSISTENT_BACKOFF_MIN 1.0
+#define PERSISTENT_BACKOFF_MAX 60.0
+#define PERSISTENT_TIMEOUT     5.0
+
 //
 // ENUMS
 //
@@ -47,7 +98,19 @@ enum succade_block_type
 	BLOCK_ONCE,
 	BLOCK_TIMED,
 	BLOCK_SPARKED,
-	BLOCK_LIVE
+	BLOCK_LIVE,
+	BLOCK_PUSH,
+	BLOCK_SOURCED
+};
+
+enum succade_spark_type
+{
+	SPARK_CHILD,             // trigger command, run as child process
+	SPARK_INOTIFY,           // inotify:/path[:events]
+	SPARK_UEVENT,            // uevent:[subsystem]
+	SPARK_NETLINK,           // netlink:link|addr|route[,...]
+	SPARK_SOCKET,            // socket:/path[:greeting]
+	SPARK_BLOCK              // block:name
 };
 
 enum succade_fdesc_type
@@ -59,6 +122,7 @@ enum succade_fdesc_type
 
 typedef enum succade_thing_type thing_type_e;
 typedef enum succade_block_type block_type_e;
+typedef enum succade_spark_type spark_type_e;
 typedef enum succade_fdesc_type fdesc_type_e;
 
 enum succade_lemon_opt
@@ -81,6 +145,7 @@ enum succade_lemon_opt
 	LEMON_OPT_FG,          // -F: default foreground color
 	LEMON_OPT_LC,          // -U: underline color
 	LEMON_OPT_SEPARATOR,   // string to separate blocks with
+	LEMON_OPT_SHELL,       // persistent shell for shell mode blocks
 	LEMON_OPT_COUNT
 };
 
@@ -108,9 +173,35 @@ enum succade_block_opt
 	BLOCK_OPT_UNIT,          // string: unit
 	BLOCK_OPT_TRIGGER,       // string: trigger binary
 	BLOCK_OPT_CONSUME,       // bool: consume trigger output
+	BLOCK_OPT_DEBOUNCE,      // float: wait for trigger to calm down
+	BLOCK_OPT_TRIG_MATCH,    // string: only run if trigger output matches
+	BLOCK_OPT_TRIG_IGNORE,   // string: don't run if trigger output matches
+	BLOCK_OPT_TRIG_DISTINCT, // bool: don't run if trigger output is the same
 	BLOCK_OPT_RELOAD,        // bool: reload if dead
 	BLOCK_OPT_LIVE,          // bool: live (keeps running)
+	BLOCK_OPT_PUSH,          // string: FIFO to read output from
+	BLOCK_OPT_MULTIPLEX,     // bool: output feeds other blocks, not shown
+	BLOCK_OPT_SOURCE,        // string: multiplexed block to get output from
+	BLOCK_OPT_FIELD,         // string: field of the source's output to use
+	BLOCK_OPT_SCRIPT,        // string: Lua script to run instead of a command
+	BLOCK_OPT_SHELL,         // bool: run command in the persistent shell
+	BLOCK_OPT_PERSISTENT,    // bool: keep process running, request via stdin
+	BLOCK_OPT_SPLIT,         // string: field separator for `field`
+	BLOCK_OPT_REGEX,         // string: regex whose capture to keep
+	BLOCK_OPT_TR,            // string: characters to replace or delete
+	BLOCK_OPT_TRIM,          // bool: remove leading/trailing white space
+	BLOCK_OPT_MAX_LENGTH,    // int: maximum output length in characters
+	BLOCK_OPT_MAP,           // string: output values to replace
+	BLOCK_OPT_FORMAT,        // string: numeric format, 'bytes' or 'bar:N'
+	BLOCK_OPT_FG_IF,         // string: foreground color thresholds
+	BLOCK_OPT_BG_IF,         // string: background color thresholds
+	BLOCK_OPT_LABEL_IF,      // string: label thresholds
 	BLOCK_OPT_RAW,           // bool: don't escape '%'
+	BLOCK_OPT_SIGNAL,        // int: run on SIGRTMIN+N
+	BLOCK_OPT_IF_CHANGED,    // string: only run if file changed
+	BLOCK_OPT_IF_EXISTS,     // string: only run if file exists
+	BLOCK_OPT_IF_MISSING,    // string: only run if file doesn't exist
+	BLOCK_OPT_IF_OUTPUT,     // string: only run if block output matches
 	BLOCK_OPT_CMD_LMB,       // string: run on left click
 	BLOCK_OPT_CMD_MMB,       // string: run on middle click
 	BLOCK_OPT_CMD_RMB,       // string: run on right click
@@ -129,10 +220,199 @@ typedef enum succade_block_opt block_opt_e;
 struct succade_thing;
 struct succade_prefs;
 struct succade_state;
+struct succade_cond;
+struct succade_rule;
+struct succade_fmt;
+struct succade_filter;
+struct succade_sub;
+struct succade_status_entry;
+struct succade_status_page;
+struct succade_builtin;
+struct succade_plugin_block;
+struct succade_shell;
+struct succade_shell_job;
 
 typedef struct succade_thing thing_s;
 typedef struct succade_prefs prefs_s;
 typedef struct succade_state state_s;
+typedef struct succade_cond  cond_s;
+typedef struct succade_rule  rule_s;
+typedef struct succade_fmt   fmt_s;
+typedef struct succade_filter filter_s;
+typedef struct succade_sub   sub_s;
+typedef struct succade_status_entry status_entry_s;
+typedef struct succade_status_page  status_page_s;
+typedef struct succade_builtin      builtin_s;
+typedef struct succade_plugin_block plugin_s;
+typedef struct succade_shell        shell_s;
+typedef struct succade_shell_job    shell_job_s;
+
+/*
+ * A built-in provider generates block output within succade's own process. 
+ * `init` is called once, with the argument given after the provider's name in 
+ * the block's command, and may store private data in the block's `data`. 
+ * `run` writes the block's output to `buf`, given the consumed trigger output 
+ * (or NULL), and returns the number of seconds until the output is expected 
+ * to change, or 0 if unknown. `free` releases the block's `data`. 
+ * `init` and `free` are optional.
+ */
+typedef int    (*builtin_init_fn)(thing_s *block, const char *arg);
+typedef double (*builtin_run_fn)(thing_s *block, const char *input, char *buf, size_t len);
+typedef void   (*builtin_free_fn)(thing_s *block);
+
+struct succade_cond
+{
+	char         *changed;   // path of file that needs to change (mtime/size)
+	struct stat   last;      // stat() of that file as of the last check
+	unsigned char seen : 1;  // has the file been stat()'ed before?
+	thing_s      *block;     // block whose output needs to match `regex`
+	regex_t       regex;     // compiled pattern for the block's output
+	unsigned char negate : 1;// run if the output does _not_ match?
+	regex_t       match;     // trigger output has to match this ...
+	regex_t       ignore;    // ... but must not match this
+	unsigned char has_match  : 1;
+	unsigned char has_ignore : 1;
+	char         *payload;   // last trigger output that was accepted
+};
+
+/*
+ * A block's output filter, see filter.c.
+ */
+struct succade_filter
+{
+	regex_t       regex;     // pattern for regex-capture
+	unsigned char has_regex : 1;
+	unsigned char has_tr : 1;
+	unsigned char trim : 1;  // remove leading and trailing white space?
+	int           field;     // field to keep (1-based, negative from the end)
+	const char   *split;     // field separator, NULL for runs of blanks
+	short         tr[256];   // replacement for every byte, -1 to delete it
+	size_t        max_len;   // maximum length in characters, 0 for none
+};
+
+struct succade_rule
+{
+	char          op[2];     // "<", "<=", ">", ">=" or "=" (not terminated)
+	char         *key;       // number or string to compare the output with
+	double        limit;     // `key` as a number
+	char         *value;     // color, label or replacement if the rule matches
+};
+
+/*
+ * A block's output formatter, see format.c. The `cur_*` fields and `text` 
+ * are the result of formatting the block's current output.
+ */
+struct succade_fmt
+{
+	rule_s       *map;       // output values to replace (no operators)
+	size_t        num_map;
+	const char   *number;    // printf() format for the output's number
+	int           bar;       // width of a percent bar, if any
+	char          bar_full;  // character for the filled part of the bar
+	char          bar_empty; // character for the rest of the bar
+	unsigned char bytes : 1; // show the number as a humanized byte size?
+	rule_s       *fg;        // thresholds for the foreground color
+	size_t        num_fg;
+	rule_s       *bg;        // thresholds for the background color
+	size_t        num_bg;
+	rule_s       *label;     // thresholds for the label
+	size_t        num_label;
+	const char   *cur_fg;    // foreground color to use instead, or NULL
+	const char   *cur_bg;    // background color to use instead, or NULL
+	const char   *cur_label; // label to use instead, or NULL
+	char         *text;      // formatted output, or NULL
+};
+
+struct succade_sub
+{
+	kita_watch_s *watch;     // connection to the subscriber
+	char         *queue;     // lines yet to be sent (BUFFER_SUBSCRIBER bytes)
+	size_t        len;       // number of bytes in the queue
+	size_t        keep;      // bytes of a partially sent line at the front
+	size_t        dropped;   // number of lines dropped due to a full queue
+	char          line[BUFFER_BLOCK_NAME]; // partial line received so far
+	size_t        line_len;  // bytes in line, sizeof(line) if too long
+	unsigned char feed : 1;  // waiting for the connection to be writable?
+};
+
+/*
+ * The status page is a file in shared memory (tmpfs) that holds the current 
+ * state of all blocks, for other programs to mmap() and read without any 
+ * syscalls. Each entry is guarded by a seqlock: `seq` is odd while succade 
+ * is writing the entry. Readers load `seq` (acquire), copy the entry, issue 
+ * an acquire fence and load `seq` again; if it is odd or has changed, retry.
+ */
+struct succade_status_entry
+{
+	atomic_uint   seq;       // seqlock sequence, odd while being written
+	uint32_t      type;      // block type, see succade_block_type
+	double        updated;   // CLOCK_MONOTONIC time of last output change
+	uint64_t      runs;      // number of times the block has been run
+	uint64_t      changes;   // number of times the block's output changed
+	char          name[BUFFER_BLOCK_NAME];
+	char          output[BUFFER_BLOCK_RESULT];
+};
+
+struct succade_status_page
+{
+	uint32_t      magic;     // STATUS_PAGE_MAGIC
+	uint32_t      version;   // STATUS_PAGE_VERSION
+	uint32_t      num_entries;
+	uint32_t      entry_size;// sizeof(status_entry_s)
+	status_entry_s entries[];
+};
+
+struct succade_builtin
+{
+	const char     *name;    // name used in the command, as in `builtin:name`
+	builtin_init_fn init;
+	builtin_run_fn  run;
+	builtin_free_fn free;
+};
+
+/*
+ * A block's instance of a loaded plugin. The plugin's functions are called 
+ * from worker threads, which hand their results back to the main thread via
+ * the fields guarded by `lock`, followed by a write to an eventfd.
+ */
+struct succade_plugin_block
+{
+	void         *dl;        // handle returned by dlopen()
+	const struct succade_plugin *api;
+	void         *ctx;       // plugin's private context, as returned by init()
+	pthread_mutex_t run;     // held while one of the plugin's functions runs
+	pthread_mutex_t lock;    // guards the fields below
+	char          pending[BUFFER_BLOCK_RESULT]; // last published output
+	double        next;      // return value of the last poll()
+	unsigned char published : 1; // has `pending` not been collected yet?
+	unsigned char polled : 1;    // has poll() returned, not collected yet?
+};
+
+struct succade_shell_job
+{
+	thing_s      *block;     // block whose command to run
+	char         *input;     // consumed trigger output, or NULL
+};
+
+/*
+ * The persistent shell that runs the commands of shell mode blocks, one at 
+ * a time, see shell.c. Blocks waiting for their turn are kept in a queue.
+ */
+struct succade_shell
+{
+	kita_child_s *child;     // the shell process
+	char          token[BUFFER_SHELL_TOKEN]; // marks responses of this process
+	unsigned long seq;       // number of the last request sent
+	thing_s      *block;     // block whose command is running, or NULL
+	double        sent;      // when the running command was sent
+	double        spawned;   // when the shell was last started
+	double        backoff;   // seconds to wait before restarting the shell
+	shell_job_s  *jobs;      // ring buffer of blocks waiting to be run
+	size_t        size;      // capacity of `jobs`
+	size_t        head;      // index of the next job to run
+	size_t        len;       // number of waiting jobs
+	unsigned char up : 1;    // is the shell running?
+};
 
 struct succade_thing
 {
@@ -140,15 +420,40 @@ struct succade_thing
 	cfg_s         cfg;       // holds the config's options
 
 	kita_child_s *child;     // kita child process struct
+	const builtin_s *builtin;// built-in provider, instead of a child (blocks)
+	void         *data;      // built-in provider's private data
+	double        wake;      // when a built-in or plugin block wants to run next,
+	                         // or a persistent block may be restarted
+	plugin_s     *plugin;    // loaded plugin, instead of a child (blocks)
 
 	thing_type_e  t_type;    // thing type (lemon, block, spark?) 
 	block_type_e  b_type;    // block type (once, timed, sparked, live?)
-	thing_s      *other;     // associated block (for sparks) or spark (for blocks) 
+	spark_type_e  s_type;    // spark type (child, inotify, uevent, netlink, socket, block?)
+	int           wd;        // inotify watch descriptor (for inotify sparks)
+	unsigned      mask;      // event mask (for inotify and netlink sparks)
+	kita_watch_s *watch;     // connection or FIFO (for socket sparks, push blocks)
+	char         *partial;   // incomplete line read so far (ditto)
+	size_t        greeted;   // bytes of the greeting sent so far (for socket sparks)
+	double        backoff;   // seconds to wait before reconnecting (for socket and inotify sparks)
+	                         // or restarting (for persistent blocks)
+	thing_s      *other;     // associated spark or source (for sparked/sourced blocks),
+	                         // or the block whose output is the trigger (block sparks)
+	cond_s       *cond;      // run conditions, checked before opening
+	filter_s     *filter;    // output filter, applied when reading output
+	fmt_s        *fmt;       // output formatter, applied when output changes
+	thing_s      *host;      // block whose child process we share, if any
 
 	char         *output;    // last output from stdout
+	char         *input;     // pending spark output, yet to be consumed
 	unsigned char alive : 1; // is up and running?
+	unsigned char due   : 1; // forced to run asap, regardless of type?
+	unsigned char paused: 1; // not to be run until resumed?
+	unsigned char in_shell : 1; // run by the persistent shell (blocks)?
+	unsigned char persistent : 1; // child keeps running between runs (blocks)?
+	unsigned char connecting : 1; // waiting for the connection (socket sparks)?
 	double        last_open; // timestamp (in seconds) of last open operation
 	double        last_read; // timestamp (in seconds) of last read operation
+	double        last_input;// timestamp (in seconds) of last spark input
 };
 
 struct succade_prefs
@@ -170,6 +475,23 @@ struct succade_state
 	size_t   num_blocks;     // Number of blocks in blocks array
 	size_t   num_sparks;     // Number of sparks in sparks array
 	kita_state_s *kita;
+	kita_watch_s *clock;     // timerfd, fires on clock jumps and resume
+	kita_watch_s *signals;   // signalfd, fires on SIGRTMIN+N for blocks
+	kita_watch_s *inotify;   // inotify instance shared by all inotify sparks
+	kita_watch_s *uevent;    // NETLINK_KOBJECT_UEVENT socket for uevent sparks
+	kita_watch_s *netlink;   // NETLINK_ROUTE socket for netlink sparks
+	kita_watch_s *control;   // datagram socket for runtime commands
+	char         *control_path; // path of the control socket
+	kita_watch_s *events;    // stream socket for output change subscribers
+	char         *events_path;  // path of the events socket
+	sub_s        *subs;      // subscribers connected to the events socket
+	size_t        num_subs;  // number of subscribers
+	status_page_s *status;   // shared memory status page, one entry per block
+	size_t        status_size;  // size of the status page in bytes
+	char         *status_path;  // path of the status page
+	kita_watch_s *plugins;   // eventfd, fires when plugins have results
+	shell_s      *shell;     // persistent shell for shell mode blocks, or NULL
+	double   slept;          // time spent in suspend, as of last check
 	unsigned char due : 1;
 };
 